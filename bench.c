@@ -0,0 +1,554 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define DEBUG
+
+#include "bool.h"
+#include "try.h"
+#include "maze.h"
+#include "generator.h"
+#include "solver.h"
+#include "bitboard.h"
+
+#define MAXSIZES 32
+#define COUNTLIMIT 100
+#define DEFAULTSEED 1
+
+/**
+ * The options maze-bench was run with: the sizes of the square mazes to time
+ * each case on, the seed of every maze, whether to write JSON rather than CSV,
+ * and the directory the files of the import and export cases are written to.
+ */
+struct options
+{
+    int nsizes, sizes[MAXSIZES];
+    unsigned long seed;
+    bool json;
+    char dir[256];
+};
+
+/**
+ * A case to time. The case is run on a maze of size by size rooms, and sets
+ * seconds to the time taken by the part of it being measured, leaving out the
+ * time taken to set it up.
+ */
+struct benchcase
+{
+    char *name;
+    bool (*run)(struct options *options, int size, double *seconds);
+};
+
+/**
+ * What a child process reports to the parent once it has run a case.
+ */
+struct result
+{
+    bool ok;
+    double seconds;
+    long maxrss;
+};
+
+bool benchGenerate(struct options *options, int size, double *seconds);
+bool benchGenerateKruskal(struct options *options, int size, double *seconds);
+bool benchGeneratePrim(struct options *options, int size, double *seconds);
+bool benchGenerateWilson(struct options *options, int size, double *seconds);
+bool benchGenerateBinary(struct options *options, int size, double *seconds);
+bool benchGenerateSidewinder(struct options *options, int size, double *seconds);
+bool benchExportText(struct options *options, int size, double *seconds);
+bool benchExportBinary(struct options *options, int size, double *seconds);
+bool benchImportText(struct options *options, int size, double *seconds);
+bool benchImportBinary(struct options *options, int size, double *seconds);
+bool benchExportCompressed(struct options *options, int size, double *seconds);
+bool benchImportCompressed(struct options *options, int size, double *seconds);
+bool benchPrint(struct options *options, int size, double *seconds);
+bool benchBfs(struct options *options, int size, double *seconds);
+bool benchAStar(struct options *options, int size, double *seconds);
+bool benchBidirectional(struct options *options, int size, double *seconds);
+bool benchFloodDistances(struct options *options, int size, double *seconds);
+bool benchFloodReach(struct options *options, int size, double *seconds);
+bool benchCount(struct options *options, int size, double *seconds);
+bool benchCarve(struct options *options, int size, int algorithm, double *seconds);
+bool benchExport(struct options *options, int size, int format, double *seconds);
+bool benchImport(struct options *options, int size, int format, double *seconds);
+bool benchSolve(struct options *options, int size, int algorithm, double *seconds);
+bool benchFlood(struct options *options, int size, bool distances, double *seconds);
+bool runCase(struct options *options, struct benchcase *benchcase, int size, struct result *result);
+void printResult(struct options *options, char *name, int size, struct result *result, bool first);
+void makeFilename(struct options *options, int format, char *filename);
+double getTime(void);
+bool parseArguments(int argc, char **argv, struct options *options);
+void printHelp(void);
+
+struct benchcase cases[] =
+{
+    {"generate", benchGenerate},
+    {"generate-kruskal", benchGenerateKruskal},
+    {"generate-prim", benchGeneratePrim},
+    {"generate-wilson", benchGenerateWilson},
+    {"generate-binary", benchGenerateBinary},
+    {"generate-sidewinder", benchGenerateSidewinder},
+    {"export-text", benchExportText},
+    {"import-text", benchImportText},
+    {"export-binary", benchExportBinary},
+    {"import-binary", benchImportBinary},
+    {"export-compressed", benchExportCompressed},
+    {"import-compressed", benchImportCompressed},
+    {"print", benchPrint},
+    {"solve-bfs", benchBfs},
+    {"solve-astar", benchAStar},
+    {"solve-bibfs", benchBidirectional},
+    {"flood-distances", benchFloodDistances},
+    {"flood-reach", benchFloodReach},
+    {"count", benchCount},
+    {NULL, NULL}
+};
+
+int main(int argc, char **argv)
+{
+    bool passed, first;
+    int i, j;
+    struct options options;
+    struct result result;
+
+    passed = true;
+    first = true;
+    options.nsizes = 0;
+    options.seed = DEFAULTSEED;
+    options.json = false;
+    strcpy(options.dir, ".");
+    if (!parseArguments(argc, argv, &options)) return EXIT_FAILURE;
+    if (options.nsizes == 0)
+    {
+        options.sizes[options.nsizes++] = 10;
+        options.sizes[options.nsizes++] = 100;
+        options.sizes[options.nsizes++] = 1000;
+        options.sizes[options.nsizes++] = 4000;
+    }
+    if (options.json) printf("[\n");
+    else printf("case,height,width,rooms,seconds,ns_per_room,peak_rss_kb\n");
+    for (i = 0; i < options.nsizes; i++)
+    {
+        for (j = 0; cases[j].name; j++)
+        {
+            if (cases[j].run == benchCount && options.sizes[i] > COUNTLIMIT) continue;
+            if (runCase(&options, &cases[j], options.sizes[i], &result))
+            {
+                printResult(&options, cases[j].name, options.sizes[i], &result, first);
+                first = false;
+            }
+            else
+            {
+                fprintf(stderr, "maze-bench: %s failed on a %ix%i maze\n", cases[j].name,
+                    options.sizes[i], options.sizes[i]);
+                passed = false;
+            }
+        }
+    }
+    if (options.json) printf("\n]\n");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Runs a case in a child process of its own, so that the peak memory use the
+ * child reports is that of the case alone.
+ */
+bool runCase(struct options *options, struct benchcase *benchcase, int size, struct result *result)
+{
+    bool ran;
+    int pipes[2], status;
+    pid_t child;
+    struct rusage usage;
+
+    ran = false;
+    pipes[0] = pipes[1] = -1;
+    TRY(pipe(pipes) == 0);
+    fflush(stdout);
+    TRY( (child = fork()) >= 0 );
+    if (child == 0)
+    {
+        close(pipes[0]);
+        result->ok = benchcase->run(options, size, &result->seconds);
+        getrusage(RUSAGE_SELF, &usage);
+        result->maxrss = usage.ru_maxrss;
+        status = write(pipes[1], result, sizeof *result) == sizeof *result;
+        _exit(status ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(pipes[1]);
+    pipes[1] = -1;
+    status = read(pipes[0], result, sizeof *result) == sizeof *result;
+    TRY(waitpid(child, NULL, 0) == child);
+    TRY(status && result->ok);
+    ran = true;
+
+FINALLY:
+    if (pipes[0] >= 0) close(pipes[0]);
+    if (pipes[1] >= 0) close(pipes[1]);
+    return ran;
+}
+
+void printResult(struct options *options, char *name, int size, struct result *result, bool first)
+{
+    double rooms;
+
+    rooms = (double)size * size;
+    if (options->json)
+    {
+        printf("%s  {\"case\": \"%s\", \"height\": %i, \"width\": %i, \"rooms\": %.0f, ",
+            first ? "" : ",\n", name, size, size, rooms);
+        printf("\"seconds\": %.6f, \"ns_per_room\": %.2f, \"peak_rss_kb\": %li}",
+            result->seconds, result->seconds * 1e9 / rooms, result->maxrss);
+    }
+    else
+        printf("%s,%i,%i,%.0f,%.6f,%.2f,%li\n", name, size, size, rooms, result->seconds,
+            result->seconds * 1e9 / rooms, result->maxrss);
+    fflush(stdout);
+}
+
+/**
+ * Times filling a new maze and carving it with a recursive backtracker.
+ */
+bool benchGenerate(struct options *options, int size, double *seconds)
+{
+    bool generated;
+    double start;
+    struct rng rng;
+    Maze maze;
+
+    generated = false;
+    maze = NULL;
+    Rng_seed(&rng, options->seed);
+    start = getTime();
+    TRY( (maze = Maze_newFilled(size, size)) );
+    TRY(Generator_generateFrom(maze, Maze_getRandomRoom(maze, &rng), 0, NULL, &rng));
+    *seconds = getTime() - start;
+    generated = true;
+
+FINALLY:
+    Maze_free(&maze);
+    return generated;
+}
+
+bool benchGenerateKruskal(struct options *options, int size, double *seconds)
+{
+    return benchCarve(options, size, Generator_kruskal, seconds);
+}
+
+bool benchGeneratePrim(struct options *options, int size, double *seconds)
+{
+    return benchCarve(options, size, Generator_prim, seconds);
+}
+
+bool benchGenerateWilson(struct options *options, int size, double *seconds)
+{
+    return benchCarve(options, size, Generator_wilson, seconds);
+}
+
+bool benchGenerateBinary(struct options *options, int size, double *seconds)
+{
+    return benchCarve(options, size, Generator_binary, seconds);
+}
+
+bool benchGenerateSidewinder(struct options *options, int size, double *seconds)
+{
+    return benchCarve(options, size, Generator_sidewinder, seconds);
+}
+
+bool benchExportText(struct options *options, int size, double *seconds)
+{
+    return benchExport(options, size, Maze_formatText, seconds);
+}
+
+bool benchExportBinary(struct options *options, int size, double *seconds)
+{
+    return benchExport(options, size, Maze_formatBinary, seconds);
+}
+
+bool benchImportText(struct options *options, int size, double *seconds)
+{
+    return benchImport(options, size, Maze_formatText, seconds);
+}
+
+bool benchImportBinary(struct options *options, int size, double *seconds)
+{
+    return benchImport(options, size, Maze_formatBinary, seconds);
+}
+
+bool benchExportCompressed(struct options *options, int size, double *seconds)
+{
+    return benchExport(options, size, Maze_formatCompressed, seconds);
+}
+
+bool benchImportCompressed(struct options *options, int size, double *seconds)
+{
+    return benchImport(options, size, Maze_formatCompressed, seconds);
+}
+
+bool benchBfs(struct options *options, int size, double *seconds)
+{
+    return benchSolve(options, size, Solver_bfs, seconds);
+}
+
+bool benchAStar(struct options *options, int size, double *seconds)
+{
+    return benchSolve(options, size, Solver_astar, seconds);
+}
+
+bool benchBidirectional(struct options *options, int size, double *seconds)
+{
+    return benchSolve(options, size, Solver_bibfs, seconds);
+}
+
+bool benchFloodDistances(struct options *options, int size, double *seconds)
+{
+    return benchFlood(options, size, true, seconds);
+}
+
+bool benchFloodReach(struct options *options, int size, double *seconds)
+{
+    return benchFlood(options, size, false, seconds);
+}
+
+/**
+ * Times filling a new maze and carving it with the algorithm given.
+ */
+bool benchCarve(struct options *options, int size, int algorithm, double *seconds)
+{
+    bool generated;
+    double start;
+    struct rng rng;
+    Maze maze;
+
+    generated = false;
+    maze = NULL;
+    Rng_seed(&rng, options->seed);
+    start = getTime();
+    TRY( (maze = Maze_newFilled(size, size)) );
+    TRY(Generator_carve(maze, algorithm, 1, 0, NULL, &rng));
+    *seconds = getTime() - start;
+    generated = true;
+
+FINALLY:
+    Maze_free(&maze);
+    return generated;
+}
+
+/**
+ * Times writing a maze to a file in the format given.
+ */
+bool benchExport(struct options *options, int size, int format, double *seconds)
+{
+    bool exported;
+    double start;
+    char filename[300];
+    Maze maze;
+
+    exported = false;
+    makeFilename(options, format, filename);
+    TRY( (maze = Generator_newMaze(size, size, false, Generator_backtrack, 1, 0, options->seed)) );
+    Maze_setFormat(maze, format);
+    start = getTime();
+    TRY(Maze_export(maze, filename));
+    *seconds = getTime() - start;
+    exported = true;
+
+FINALLY:
+    remove(filename);
+    Maze_free(&maze);
+    return exported;
+}
+
+/**
+ * Times reading back a maze written to a file in the format given.
+ */
+bool benchImport(struct options *options, int size, int format, double *seconds)
+{
+    bool imported;
+    double start;
+    char filename[300];
+    Maze maze;
+
+    imported = false;
+    makeFilename(options, format, filename);
+    TRY( (maze = Generator_newMaze(size, size, false, Generator_backtrack, 1, 0, options->seed)) );
+    Maze_setFormat(maze, format);
+    TRY(Maze_export(maze, filename));
+    Maze_free(&maze);
+    TRY( (maze = Maze_new()) );
+    start = getTime();
+    TRY(Maze_importAs(maze, filename, format));
+    *seconds = getTime() - start;
+    imported = true;
+
+FINALLY:
+    remove(filename);
+    Maze_free(&maze);
+    return imported;
+}
+
+/**
+ * Times drawing a maze, throwing the drawing away.
+ */
+bool benchPrint(struct options *options, int size, double *seconds)
+{
+    bool printed;
+    double start;
+    FILE *stream;
+    Maze maze;
+
+    printed = false;
+    stream = NULL;
+    TRY( (maze = Generator_newMaze(size, size, false, Generator_backtrack, 1, 0, options->seed)) );
+    TRY( (stream = fopen("/dev/null", "w")) );
+    start = getTime();
+    Maze_fprint(maze, stream);
+    TRY(fflush(stream) == 0);
+    *seconds = getTime() - start;
+    printed = true;
+
+FINALLY:
+    if (stream) fclose(stream);
+    Maze_free(&maze);
+    return printed;
+}
+
+/**
+ * Times finding the shortest solution to a maze with the search given.
+ */
+bool benchSolve(struct options *options, int size, int algorithm, double *seconds)
+{
+    bool solved;
+    double start;
+    Maze maze;
+
+    solved = false;
+    TRY( (maze = Generator_newMaze(size, size, false, Generator_backtrack, 1, 0, options->seed)) );
+    start = getTime();
+    TRY(Solver_findPath(maze, algorithm, NULL) >= 0);
+    *seconds = getTime() - start;
+    solved = true;
+
+FINALLY:
+    Maze_free(&maze);
+    return solved;
+}
+
+/**
+ * Times building the bit planes of a maze and flooding them from its finish
+ * room, finding either the distance of every room or only whether it can be
+ * reached.
+ */
+bool benchFlood(struct options *options, int size, bool distances, double *seconds)
+{
+    bool flooded;
+    double start;
+    int *distance;
+    Maze maze;
+    Bitboard bitboard;
+
+    flooded = false;
+    distance = NULL;
+    bitboard = NULL;
+    TRY( (maze = Generator_newMaze(size, size, false, Generator_backtrack, 1, 0, options->seed)) );
+    TRY( (distance = malloc(sizeof *distance * Maze_getRoomCount(maze))) );
+    start = getTime();
+    TRY( (bitboard = Bitboard_new(maze)) );
+    if (distances) Bitboard_findDistances(bitboard, Maze_getOffset(maze, Maze_getFinish(maze)), distance);
+    else Bitboard_findReachable(bitboard, Maze_getOffset(maze, Maze_getFinish(maze)));
+    *seconds = getTime() - start;
+    flooded = true;
+
+FINALLY:
+    Bitboard_free(&bitboard);
+    free(distance);
+    Maze_free(&maze);
+    return flooded;
+}
+
+/**
+ * Times counting every solution to a maze on a single thread.
+ */
+bool benchCount(struct options *options, int size, double *seconds)
+{
+    bool counted;
+    double start;
+    char *count;
+    Maze maze;
+
+    counted = false;
+    count = NULL;
+    TRY( (maze = Generator_newMaze(size, size, false, Generator_backtrack, 1, 0, options->seed)) );
+    start = getTime();
+    TRY( (count = Solver_countPaths(maze, 1, false)) );
+    *seconds = getTime() - start;
+    counted = true;
+
+FINALLY:
+    free(count);
+    Maze_free(&maze);
+    return counted;
+}
+
+/**
+ * Names the file the import and export cases write in the format given, one
+ * of its own for each process so that several benchmarks can share a directory.
+ */
+void makeFilename(struct options *options, int format, char *filename)
+{
+    sprintf(filename, "%s/maze-bench-%li.%s", options->dir, (long)getpid(),
+        format == Maze_formatBinary ? "mzb" : format == Maze_formatCompressed ? "mzc" : "mdf");
+}
+
+double getTime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+bool parseArguments(int argc, char **argv, struct options *options)
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp("-help", argv[i]) == 0) {printHelp(); return false;}
+        if (strcmp("-size", argv[i]) == 0 && argv[++i] && options->nsizes < MAXSIZES)
+        {
+            options->sizes[options->nsizes] = strtol(argv[i], NULL, 0);
+            if (options->sizes[options->nsizes++] < 1) {printHelp(); return false;}
+        }
+        else if (strcmp("-seed", argv[i]) == 0 && argv[++i])
+            options->seed = strtoul(argv[i], NULL, 0);
+        else if (strcmp("-json", argv[i]) == 0) options->json = true;
+        else if (strcmp("-csv", argv[i]) == 0) options->json = false;
+        else if (strcmp("-dir", argv[i]) == 0 && argv[++i])
+        {
+            strncpy(options->dir, argv[i], sizeof options->dir - 1);
+            options->dir[sizeof options->dir - 1] = '\0';
+        }
+        else {printHelp(); return false;}
+    }
+    return true;
+}
+
+void printHelp(void)
+{
+    fprintf(stderr, "USAGE: maze-bench [-size N]... [-seed S] [-csv|-json] [-dir D]\n");
+    fprintf(stderr, "    where -size times every case on an N by N maze, and may be\n");
+    fprintf(stderr, "          given more than once (10, 100, 1000 and 4000 by default),\n");
+    fprintf(stderr, "          -seed generates every maze from S (%i by default),\n", DEFAULTSEED);
+    fprintf(stderr, "          -csv or -json chooses the format of the results (CSV by\n");
+    fprintf(stderr, "          default),\n");
+    fprintf(stderr, "          -dir writes the files of the import and export cases in D\n");
+    fprintf(stderr, "          (the current directory by default)\n");
+    fprintf(stderr, "    counting is only timed on mazes of up to %i by %i rooms\n", COUNTLIMIT, COUNTLIMIT);
+}
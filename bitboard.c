@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bool.h"
+#include "try.h"
+#include "maze.h"
+#include "bitboard.h"
+
+#define NORTH 1
+#define EAST  2
+#define SOUTH 4
+#define WEST  8
+#define WORDBITS 64
+#define HIGH(X) ((uint64_t)(X) << 32)
+#define DEBRUIJN (HIGH(0x03f79d71) | 0xb4cb0a89)
+
+/**
+ * The planes of passages hold a word for every 64 rooms of a row, each row
+ * starting a new word, with the bits past the end of a row always clear; the
+ * planes are indexed by the bit of the wall they stand for, NORTH first. The
+ * reached plane holds the rooms reached so far by the search. The frontier
+ * plane holds the rooms reached at the last step and the next plane those being
+ * reached at this one, but only the words on the active and upcoming lists are
+ * ever read from them: a word is put on the upcoming list, and its next word
+ * cleared, when it first gains a room at a step, which its stamp records. The
+ * first room of each word is kept to spare working it out again. The search
+ * also notes the number of the last step and one room reached at it, and the
+ * step at which the target room, if any, is reached. No room at the
+ * edge of the maze has a passage out of it, so the rooms shifted past the end of
+ * a word, or moved above the first row or below the last, are always none.
+ */
+struct bitboard
+{
+    int width, rowwords, nwords, nrooms, depth, farthest, targetword, targetstep;
+    uint64_t targetbit, *planes[4], *reached, *frontier, *next;
+    int *active, *upcoming, *stamp, *first;
+};
+
+int flood(struct bitboard *this, int from, int to, int *distance);
+int spread(struct bitboard *this, int word, uint64_t bits, int step, int *nupcoming, int *distance);
+int fill(struct bitboard *this, int from);
+void push(struct bitboard *this, int word, uint64_t bits, int *npending);
+int lowestBit(uint64_t bits);
+
+Bitboard Bitboard_new(Maze maze)
+{
+    bool built;
+    int i, x, y, room, height, walls, word;
+    uint64_t bit, north, east, south, west;
+    Bitboard this;
+
+    built = false;
+    TRY( (this = malloc(sizeof *this)) );
+    height = Maze_getHeight(maze);
+    this->width = Maze_getWidth(maze);
+    this->rowwords = (this->width + WORDBITS - 1) / WORDBITS;
+    this->nwords = height * this->rowwords;
+    this->nrooms = height * this->width;
+    this->planes[0] = this->planes[1] = this->planes[2] = this->planes[3] = NULL;
+    this->reached = this->frontier = this->next = NULL;
+    this->active = this->upcoming = this->stamp = this->first = NULL;
+    for (i = 0; i < 4; i++) TRY( (this->planes[i] = calloc(this->nwords, sizeof *this->planes[i])) );
+    TRY( (this->reached = calloc(this->nwords, sizeof *this->reached)) );
+    TRY( (this->frontier = malloc(sizeof *this->frontier * this->nwords)) );
+    TRY( (this->next = malloc(sizeof *this->next * this->nwords)) );
+    TRY( (this->active = malloc(sizeof *this->active * this->nwords)) );
+    TRY( (this->upcoming = malloc(sizeof *this->upcoming * this->nwords)) );
+    TRY( (this->stamp = malloc(sizeof *this->stamp * this->nwords)) );
+    TRY( (this->first = malloc(sizeof *this->first * this->nwords)) );
+    for (room = word = x = 0; x < height; x++)
+        for (y = 0; y < this->width; word++)
+        {
+            this->first[word] = room;
+            north = east = south = west = 0;
+            for (bit = 1; bit && y < this->width; bit <<= 1, y++, room++)
+            {
+                walls = Maze_getWallsAt(maze, room);
+                if (!(walls & NORTH) && x > 0) north |= bit;
+                if (!(walls & EAST) && y < this->width - 1) east |= bit;
+                if (!(walls & SOUTH) && x < height - 1) south |= bit;
+                if (!(walls & WEST) && y > 0) west |= bit;
+            }
+            this->planes[0][word] = north;
+            this->planes[1][word] = east;
+            this->planes[2][word] = south;
+            this->planes[3][word] = west;
+        }
+    built = true;
+
+FINALLY:
+    if (!built) Bitboard_free(&this);
+    return this;
+}
+
+void Bitboard_free(Bitboard *this)
+{
+    int i;
+
+    if (*this)
+    {
+        for (i = 0; i < 4; i++) free((*this)->planes[i]);
+        free((*this)->reached);
+        free((*this)->frontier);
+        free((*this)->next);
+        free((*this)->active);
+        free((*this)->upcoming);
+        free((*this)->stamp);
+        free((*this)->first);
+    }
+    free(*this);
+    *this = NULL;
+}
+
+int Bitboard_findDistances(Bitboard this, int from, int *distance)
+{
+    int i;
+
+    for (i = 0; i < this->nrooms; i++) distance[i] = -1;
+    return flood(this, from, -1, distance);
+}
+
+int Bitboard_findFarthest(Bitboard this, int from, int to, int *farthest, int *distance)
+{
+    flood(this, from, to, NULL);
+    *farthest = this->farthest;
+    if (distance) *distance = this->targetstep;
+    return this->depth;
+}
+
+int Bitboard_findReachable(Bitboard this, int from)
+{
+    return fill(this, from);
+}
+
+bool Bitboard_isReachable(Bitboard this, int room)
+{
+    int word, y;
+
+    y = room % this->width;
+    word = room / this->width * this->rowwords + y / WORDBITS;
+    return (this->reached[word] >> (y % WORDBITS) & 1) != 0;
+}
+
+/**
+ * Runs a breadth-first search one step at a time. At each step, every word of
+ * the frontier moves its rooms east and west by shifting them across the word,
+ * carrying the end rooms into the word beside it, and north and south by moving
+ * them to the word above or below, each masked by the plane of that direction.
+ * The distance of each room is only written if distance is not NULL.
+ *
+ * \return The number of rooms reached, which is only counted if distance is not
+ *     NULL.
+ */
+int flood(struct bitboard *this, int from, int to, int *distance)
+{
+    int i, step, count, word, nactive, nupcoming, *swaplist;
+    uint64_t bits, east, west, *swapplane;
+
+    memset(this->reached, 0, sizeof *this->reached * this->nwords);
+    for (i = 0; i < this->nwords; i++) this->stamp[i] = -1;
+    word = from / this->width * this->rowwords + from % this->width / WORDBITS;
+    this->reached[word] = this->frontier[word] = (uint64_t)1 << (from % this->width % WORDBITS);
+    if (distance) distance[from] = 0;
+    this->targetword = to < 0 ? -1 : to / this->width * this->rowwords + to % this->width / WORDBITS;
+    this->targetbit = to < 0 ? 0 : (uint64_t)1 << (to % this->width % WORDBITS);
+    this->targetstep = to == from ? 0 : -1;
+    this->active[0] = word;
+    nactive = count = 1;
+    for (step = 1; nactive > 0; step++)
+    {
+        word = this->active[0];
+        this->farthest = this->first[word] + lowestBit(this->frontier[word]);
+        nupcoming = 0;
+        for (i = 0; i < nactive; i++)
+        {
+            word = this->active[i];
+            bits = this->frontier[word];
+            east = bits & this->planes[1][word];
+            west = bits & this->planes[3][word];
+            if (east | west)
+                count += spread(this, word, east << 1 | west >> 1, step, &nupcoming, distance);
+            if (east >> (WORDBITS - 1))
+                count += spread(this, word + 1, east >> (WORDBITS - 1), step, &nupcoming, distance);
+            if (west & 1)
+                count += spread(this, word - 1, west << (WORDBITS - 1), step, &nupcoming, distance);
+            if (bits & this->planes[0][word])
+                count += spread(this, word - this->rowwords, bits & this->planes[0][word], step, &nupcoming, distance);
+            if (bits & this->planes[2][word])
+                count += spread(this, word + this->rowwords, bits & this->planes[2][word], step, &nupcoming, distance);
+        }
+        swaplist = this->active; this->active = this->upcoming; this->upcoming = swaplist;
+        swapplane = this->frontier; this->frontier = this->next; this->next = swapplane;
+        nactive = nupcoming;
+    }
+    this->depth = step - 2;
+    return count;
+}
+
+/**
+ * Adds the rooms of a word stepped into that have not been reached before to
+ * the rooms reached at this step, and gives them their distance if distance is
+ * not NULL.
+ *
+ * \return The number of rooms newly reached.
+ */
+int spread(struct bitboard *this, int word, uint64_t bits, int step, int *nupcoming, int *distance)
+{
+    int count;
+
+    if ((bits &= ~this->reached[word]) == 0) return 0;
+    this->reached[word] |= bits;
+    if (this->stamp[word] != step)
+    {
+        this->stamp[word] = step;
+        this->next[word] = 0;
+        this->upcoming[(*nupcoming)++] = word;
+    }
+    this->next[word] |= bits;
+    if (word == this->targetword && (bits & this->targetbit)) this->targetstep = step;
+    if (!distance) return 0;
+    for (count = 0; bits; bits &= bits - 1, count++)
+        distance[this->first[word] + lowestBit(bits)] = step;
+    return count;
+}
+
+/**
+ * Finds the rooms that can be reached without keeping to the order of a
+ * breadth-first search, which lets each word taken from the pending stack
+ * spread its rooms east and west, again and again, until no more of the word
+ * can be reached, before passing them on to the words around it. The frontier
+ * plane holds the rooms of each pending word not yet spread from, and the stamp
+ * of a word is 1 while it is on the stack.
+ *
+ * \return The number of rooms reached.
+ */
+int fill(struct bitboard *this, int from)
+{
+    int i, count, word, npending;
+    uint64_t bits, grown;
+
+    memset(this->reached, 0, sizeof *this->reached * this->nwords);
+    for (i = 0; i < this->nwords; i++) this->stamp[i] = 0;
+    npending = 0;
+    push(this, from / this->width * this->rowwords + from % this->width / WORDBITS,
+        (uint64_t)1 << (from % this->width % WORDBITS), &npending);
+    while (npending > 0)
+    {
+        word = this->active[--npending];
+        this->stamp[word] = 0;
+        bits = this->frontier[word];
+        /* run along the row as far as the word goes */
+        for (;;)
+        {
+            grown = ((bits & this->planes[1][word]) << 1 | (bits & this->planes[3][word]) >> 1)
+                & ~this->reached[word];
+            if (grown == 0) break;
+            this->reached[word] |= grown;
+            bits |= grown;
+        }
+        push(this, word + 1, (bits & this->planes[1][word]) >> (WORDBITS - 1), &npending);
+        push(this, word - 1, (bits & this->planes[3][word]) << (WORDBITS - 1), &npending);
+        push(this, word - this->rowwords, bits & this->planes[0][word], &npending);
+        push(this, word + this->rowwords, bits & this->planes[2][word], &npending);
+    }
+    for (count = word = 0; word < this->nwords; word++)
+        for (bits = this->reached[word]; bits; bits &= bits - 1) count++;
+    return count;
+}
+
+/**
+ * Marks the rooms of a word not reached before as reached, and puts the word on
+ * the pending stack to spread from them, if it is not on it already.
+ */
+void push(struct bitboard *this, int word, uint64_t bits, int *npending)
+{
+    if (bits == 0 || (bits &= ~this->reached[word]) == 0) return;
+    this->reached[word] |= bits;
+    if (this->stamp[word])
+        this->frontier[word] |= bits;
+    else
+    {
+        this->stamp[word] = 1;
+        this->frontier[word] = bits;
+        this->active[(*npending)++] = word;
+    }
+}
+
+/**
+ * Finds the lowest bit set in a word that is not 0, by multiplying the bit
+ * alone by a de Bruijn sequence, which leaves a different number in the top
+ * six bits for each bit.
+ */
+int lowestBit(uint64_t bits)
+{
+    static const int table[WORDBITS] =
+    {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+    };
+
+    return table[((bits & -bits) * DEBRUIJN) >> 58];
+}
+
+#undef NORTH
+#undef EAST
+#undef SOUTH
+#undef WEST
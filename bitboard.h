@@ -0,0 +1,100 @@
+/**
+ * \file bitboard.h
+ *
+ * The passages of a maze kept as bit planes, one for each direction, holding a
+ * bit for each room, so that a search can step from every room of a word of 64
+ * rooms of a row at once, with a shift and a mask for each direction, rather
+ * than from one room at a time. Finding only the rooms that can be reached lets
+ * each word run along its row as far as it can before moving on, and is several
+ * times quicker than searching room by room. Finding distances must keep to the
+ * order of a breadth-first search, whose frontier rarely holds more than a room
+ * or two of a word, so it costs about as much as searching room by room.
+ */
+
+#ifndef BITBOARD_HEADER
+#define BITBOARD_HEADER
+
+#include "bool.h"
+#include "maze.h"
+
+/**
+ * Opaque pointer to the bit planes of a maze and the state of the last search
+ * run over them.
+ */
+typedef struct bitboard *Bitboard;
+
+/**
+ * Builds the bit planes of a maze as it is now; later changes to the maze are
+ * not seen. A room has a passage in a direction when it has no wall that way
+ * and the way does not lead out of the maze, as Maze_getAdjacentAt sees it;
+ * markers are ignored.
+ *
+ * \param maze The maze to build the planes of.
+ *
+ * \return A new bitboard, or NULL if there was not enough memory.
+ */
+Bitboard Bitboard_new(Maze maze);
+
+/**
+ * Finds the distance of every room from a room, in exactly the steps a
+ * breadth-first search taking the rooms one at a time would find.
+ *
+ * \param this The bitboard to search.
+ * \param from The offset of the room to search from.
+ * \param distance Filled with the distance of each room from the room searched
+ *     from, or -1 for the rooms that cannot be reached; it must have space for
+ *     every room of the maze.
+ *
+ * \return The number of rooms reached, the room searched from included.
+ */
+int Bitboard_findDistances(Bitboard this, int from, int *distance);
+
+/**
+ * Finds how far the rooms furthest from a room are, and one of them, with the
+ * same breadth-first search as Bitboard_findDistances but without keeping the
+ * distance of every room, so that nothing but the bitboard itself is needed
+ * however large the maze. In a maze without loops, searching again from the
+ * room found gives the longest path in the maze.
+ *
+ * \param this The bitboard to search.
+ * \param from The offset of the room to search from.
+ * \param to The offset of another room to find the distance of, or -1.
+ * \param farthest Set to the offset of one of the rooms furthest from the room
+ *     searched from.
+ * \param distance If not NULL, set to the distance of the room to from the room
+ *     searched from, or -1 if it cannot be reached.
+ *
+ * \return The distance of the rooms furthest from the room searched from.
+ */
+int Bitboard_findFarthest(Bitboard this, int from, int to, int *farthest, int *distance);
+
+/**
+ * Finds every room that can be reached from a room, without working out how
+ * far each one is. The rooms reached can then be tested with
+ * Bitboard_isReachable.
+ *
+ * \param this The bitboard to search.
+ * \param from The offset of the room to search from.
+ *
+ * \return The number of rooms reached, the room searched from included.
+ */
+int Bitboard_findReachable(Bitboard this, int from);
+
+/**
+ * Tells whether a room was reached by the last search of a bitboard.
+ *
+ * \param this The bitboard searched.
+ * \param room The offset of the room.
+ *
+ * \return true if the room was reached, false if not.
+ */
+bool Bitboard_isReachable(Bitboard this, int room);
+
+/**
+ * Frees a bitboard and sets it to NULL.
+ *
+ * \param this The bitboard to free.
+ */
+void Bitboard_free(Bitboard *this);
+
+#endif /* BITBOARD_HEADER */
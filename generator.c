@@ -0,0 +1,703 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bool.h"
+#include "try.h"
+#include "maze.h"
+#include "generator.h"
+
+#define NORTH 1
+#define EAST  2
+#define SOUTH 4
+#define WEST  8
+
+#define STACKSTART 1024
+#define MAXTHREADS 256
+
+/**
+ * A room on the generator's stack. The rooms adjacent to it are kept in the
+ * order they were shuffled into as two bits of direction each, so that every
+ * room costs the generator no more than a few bytes however deep it goes.
+ */
+struct frame
+{
+    int room;
+    unsigned char order;
+    unsigned char count, next;
+};
+
+/**
+ * The state of a generator: the region of the maze it carves (the rooms from
+ * offset lo up to hi), its stack, its own random number generator, and a bitmap
+ * of the rooms of the region it has visited. The visited rooms are not marked
+ * in the maze itself so that the markers of the maze are never touched while
+ * generating, and so that generators carving different regions share nothing
+ * but the walls of their own rooms.
+ */
+struct generator
+{
+    Maze maze;
+    int lo, hi;
+    struct rng rng;
+    struct frame *stack;
+    size_t depth, size, maxbytes;
+    unsigned char *visited;
+    bool generated;
+};
+
+/**
+ * The memory of a workspace: the stack of the backtracker and the size it was
+ * grown to, and an array of ints and one of bytes that each algorithm cuts up as
+ * it needs. The arrays are only ever grown, and hold nothing from one maze to
+ * the next.
+ */
+struct workspace
+{
+    struct frame *stack;
+    size_t size, nints, nbytes;
+    int *ints;
+    unsigned char *bytes;
+};
+
+#define isVisited(G, R) (((G)->visited[((R) - (G)->lo) >> 3] >> (((R) - (G)->lo) & 7)) & 1)
+#define setVisited(G, R) ((G)->visited[((R) - (G)->lo) >> 3] |= 1 << (((R) - (G)->lo) & 7))
+
+void emptyWorkspace(struct workspace *this);
+void clearWorkspace(struct workspace *this);
+bool reserveWorkspace(struct workspace *this, size_t nints, size_t nbytes);
+bool generateRegion(struct generator *this, int room);
+int findNeighbours(int room, int height, int width, int *directions);
+int findSet(int *parent, int set);
+void *generateThread(void *generator);
+bool pushFrame(struct generator *this, int room);
+void shuffleRoomArray(int *array, int size, struct rng *rng);
+
+Maze Generator_newMaze(int height, int width, bool packed, int algorithm, int threads, size_t maxbytes,
+    unsigned long seed)
+{
+    bool generated;
+    struct rng rng;
+    Maze maze;
+
+    generated = false;
+    if (packed) TRY( (maze = Maze_newPacked(height, width)) );
+    else TRY( (maze = Maze_newFilled(height, width)) );
+    Rng_seed(&rng, seed);
+    TRY(Generator_carveMaze(maze, algorithm, threads, maxbytes, NULL, &rng));
+    generated = true;
+
+FINALLY:
+    if (!generated) Maze_free(&maze);
+    return maze;
+}
+
+bool Generator_carveMaze(Maze maze, int algorithm, int threads, size_t maxbytes, Workspace workspace,
+    struct rng *rng)
+{
+    bool carved;
+
+    carved = false;
+    TRY(Generator_carve(maze, algorithm, threads, maxbytes, workspace, rng));
+    Generator_makeRandomTunnels(maze, Maze_getHeight(maze)/2, rng);
+    Maze_setStart(maze, Maze_getRandomRoom(maze, rng));
+    Maze_setFinish(maze, Maze_getRandomRoom(maze, rng));
+    carved = true;
+
+FINALLY:
+    return carved;
+}
+
+bool Generator_carve(Maze maze, int algorithm, int threads, size_t maxbytes, Workspace workspace,
+    struct rng *rng)
+{
+    switch (algorithm)
+    {
+    case Generator_backtrack:
+        if (threads > 1) return Generator_generateTiled(maze, threads, maxbytes, rng);
+        return Generator_generateFrom(maze, Maze_getRandomRoom(maze, rng), maxbytes, workspace, rng);
+    case Generator_kruskal:
+        return Generator_generateKruskal(maze, workspace, rng);
+    case Generator_prim:
+        return Generator_generatePrim(maze, Maze_getRandomRoom(maze, rng), workspace, rng);
+    case Generator_wilson:
+        return Generator_generateWilson(maze, workspace, rng);
+    case Generator_binary:
+        Generator_generateBinaryTree(maze, rng);
+        return true;
+    case Generator_sidewinder:
+        Generator_generateSidewinder(maze, rng);
+        return true;
+    default:
+        return false;
+    }
+}
+
+Workspace Workspace_new(void)
+{
+    Workspace this;
+
+    if ((this = malloc(sizeof *this))) emptyWorkspace(this);
+    return this;
+}
+
+void Workspace_free(Workspace *this)
+{
+    if (*this) clearWorkspace(*this);
+    free(*this);
+    *this = NULL;
+}
+
+void emptyWorkspace(struct workspace *this)
+{
+    this->stack = NULL;
+    this->ints = NULL;
+    this->bytes = NULL;
+    this->size = this->nints = this->nbytes = 0;
+}
+
+/**
+ * Frees the memory a workspace holds, leaving it empty.
+ */
+void clearWorkspace(struct workspace *this)
+{
+    free(this->stack);
+    free(this->ints);
+    free(this->bytes);
+    emptyWorkspace(this);
+}
+
+/**
+ * Grows the arrays of a workspace to hold at least nints ints and nbytes bytes.
+ * What they held is not kept, so an array too small is freed before the larger
+ * one is allocated.
+ */
+bool reserveWorkspace(struct workspace *this, size_t nints, size_t nbytes)
+{
+    bool reserved;
+
+    reserved = false;
+    if (nints > this->nints)
+    {
+        free(this->ints);
+        this->nints = 0;
+        TRY( (this->ints = malloc(sizeof *this->ints * nints)) );
+        this->nints = nints;
+    }
+    if (nbytes > this->nbytes)
+    {
+        free(this->bytes);
+        this->nbytes = 0;
+        TRY( (this->bytes = malloc(nbytes)) );
+        this->nbytes = nbytes;
+    }
+    reserved = true;
+
+FINALLY:
+    return reserved;
+}
+
+/**
+ * Carves a maze with a recursive backtracker. The recursion is kept on a stack
+ * of its own rather than the call stack, so the depth of the maze is limited
+ * only by memory, and maxbytes (if not 0) limits that. The stack and the
+ * visited rooms are taken from the workspace, and the stack is left in it as
+ * large as it grew.
+ */
+bool Generator_generateFrom(Maze maze, Room room, size_t maxbytes, Workspace workspace, struct rng *rng)
+{
+    bool generated;
+    struct generator generator;
+    struct workspace local;
+
+    generated = false;
+    emptyWorkspace(&local);
+    if (!workspace) workspace = &local;
+    generator.maze = maze;
+    generator.lo = 0;
+    generator.hi = Maze_getRoomCount(maze);
+    generator.rng = *rng;
+    generator.maxbytes = maxbytes;
+    TRY(reserveWorkspace(workspace, 0, generator.hi / 8 + 1));
+    memset(workspace->bytes, 0, generator.hi / 8 + 1);
+    generator.visited = workspace->bytes;
+    generator.stack = workspace->stack;
+    generator.size = workspace->size;
+    generated = generateRegion(&generator, Maze_getOffset(maze, room));
+    workspace->stack = generator.stack;
+    workspace->size = generator.size;
+    *rng = generator.rng;
+
+FINALLY:
+    clearWorkspace(&local);
+    return generated;
+}
+
+/**
+ * Carves a maze on several threads at once. The maze is cut into ntiles bands
+ * of whole rows, each band is carved by a recursive backtracker of its own on
+ * its own thread, and then every band is joined to the next by a single tunnel
+ * so that the whole maze is still a spanning tree. Each band gets a random number
+ * generator split from rng in order before any thread starts, so the same seed
+ * and number of tiles always give the same maze. The bands always start on an even room so that the bands
+ * of a packed maze never share a byte.
+ */
+bool Generator_generateTiled(Maze maze, int ntiles, size_t maxbytes, struct rng *rng)
+{
+    bool generated;
+    int i, ntiled, height, width, first;
+    struct generator generators[MAXTHREADS];
+    pthread_t threads[MAXTHREADS];
+
+    generated = false;
+    ntiled = 0;
+    height = Maze_getHeight(maze);
+    width = Maze_getWidth(maze);
+    if (ntiles > MAXTHREADS) ntiles = MAXTHREADS;
+    for (i = 0, first = 0; i < ntiles && first < height; i++)
+    {
+        generators[ntiled].maze = maze;
+        generators[ntiled].lo = first * width;
+        first = (int)((long)height * (i + 1) / ntiles);
+        if (width % 2 && first % 2 && first < height) first++;
+        generators[ntiled].hi = first * width;
+        if (generators[ntiled].hi <= generators[ntiled].lo) continue;
+        Rng_split(rng, &generators[ntiled].rng);
+        generators[ntiled].maxbytes = maxbytes;
+        generators[ntiled].generated = false;
+        TRY(pthread_create(&threads[ntiled], NULL, generateThread, &generators[ntiled]) == 0);
+        ntiled++;
+    }
+    generated = true;
+
+FINALLY:
+    for (i = 0; i < ntiled; i++)
+    {
+        pthread_join(threads[i], NULL);
+        generated = generated && generators[i].generated;
+    }
+    for (i = 1; generated && i < ntiled; i++)
+    {
+        first = generators[i].lo + Rng_below(rng, width);
+        Maze_tunnelAt(maze, first - width, first);
+    }
+    return generated;
+}
+
+/**
+ * Carves one band of a tiled maze, in a stack and bitmap of visited rooms of
+ * its own.
+ */
+void *generateThread(void *generator)
+{
+    int room;
+    struct generator *this;
+
+    this = generator;
+    room = this->lo + Rng_below(&this->rng, this->hi - this->lo);
+    this->stack = NULL;
+    this->size = 0;
+    if ((this->visited = calloc((this->hi - this->lo) / 8 + 1, 1)))
+        this->generated = generateRegion(this, room);
+    free(this->stack);
+    free(this->visited);
+    return NULL;
+}
+
+bool generateRegion(struct generator *this, int room)
+{
+    bool generated;
+    int delta[4], next;
+    struct frame *top;
+
+    generated = false;
+    this->depth = 0;
+    delta[0] = -Maze_getWidth(this->maze); delta[1] = 1;
+    delta[2] = Maze_getWidth(this->maze);  delta[3] = -1;
+    TRY(pushFrame(this, room));
+    while (this->depth > 0)
+    {
+        top = &this->stack[this->depth - 1];
+        if (top->next < top->count)
+        {
+            next = top->room + delta[(top->order >> (2 * top->next++)) & 3];
+            if (!isVisited(this, next))
+                TRY(pushFrame(this, next));
+        }
+        else if (--this->depth > 0)
+            Maze_tunnelAt(this->maze, this->stack[this->depth - 1].room, top->room);
+    }
+    generated = true;
+
+FINALLY:
+    return generated;
+}
+
+bool pushFrame(struct generator *this, int room)
+{
+    bool pushed;
+    int i, nadjacent, offset, direction, adjacent[4];
+    size_t grown;
+    struct frame *frame;
+
+    pushed = false;
+    if (this->depth == this->size)
+    {
+        grown = this->size ? this->size * 2 : STACKSTART;
+        if (this->maxbytes && grown * sizeof *frame > this->maxbytes)
+            grown = this->maxbytes / sizeof *frame;
+        TRY(grown > this->size);
+        TRY( (frame = realloc(this->stack, grown * sizeof *frame)) );
+        this->stack = frame;
+        this->size = grown;
+    }
+    frame = &this->stack[this->depth++];
+    frame->room = room;
+    frame->order = frame->next = 0;
+    setVisited(this, room);
+    nadjacent = Maze_getAdjacentAt(this->maze, room, adjacent, true);
+    for (i = 0; i < nadjacent; i++)
+        if (adjacent[i] < this->lo || adjacent[i] >= this->hi)
+            adjacent[i--] = adjacent[--nadjacent];
+    if (nadjacent > 1) shuffleRoomArray(adjacent, nadjacent, &this->rng);
+    for (i = 0; i < nadjacent; i++)
+    {
+        offset = adjacent[i] - room;
+        if (offset == -Maze_getWidth(this->maze)) direction = 0;
+        else if (offset == 1) direction = 1;
+        else if (offset == Maze_getWidth(this->maze)) direction = 2;
+        else direction = 3;
+        frame->order |= direction << (2 * i);
+    }
+    frame->count = nadjacent;
+    pushed = true;
+
+FINALLY:
+    return pushed;
+}
+
+/**
+ * The walls are numbered twice the room west or north of them, plus one for the
+ * walls south of a room, and shuffled all at once; only the walls within the
+ * maze are listed. Walls are taken until every room is joined.
+ */
+bool Generator_generateKruskal(Maze maze, Workspace workspace, struct rng *rng)
+{
+    bool generated;
+    int i, room, other, first, second, height, width, nrooms, nwalls, joined, *walls, *parent;
+    unsigned char *rank;
+    struct workspace local;
+
+    generated = false;
+    emptyWorkspace(&local);
+    if (!workspace) workspace = &local;
+    height = Maze_getHeight(maze);
+    width = Maze_getWidth(maze);
+    nrooms = height * width;
+    TRY(reserveWorkspace(workspace, 3 * (size_t)nrooms, nrooms));
+    walls = workspace->ints;
+    parent = workspace->ints + 2 * (size_t)nrooms;
+    rank = workspace->bytes;
+    memset(rank, 0, nrooms);
+    for (nwalls = room = 0; room < nrooms; room++)
+    {
+        parent[room] = room;
+        if (room % width < width - 1) walls[nwalls++] = 2 * room;
+        if (room / width < height - 1) walls[nwalls++] = 2 * room + 1;
+    }
+    shuffleRoomArray(walls, nwalls, rng);
+    for (i = 0, joined = 1; i < nwalls && joined < nrooms; i++)
+    {
+        room = walls[i] / 2;
+        other = walls[i] % 2 ? room + width : room + 1;
+        first = findSet(parent, room);
+        second = findSet(parent, other);
+        if (first == second) continue;
+        if (rank[first] < rank[second]) parent[first] = second;
+        else if (rank[first] > rank[second]) parent[second] = first;
+        else parent[second] = first, rank[first]++;
+        Maze_tunnelAt(maze, room, other);
+        joined++;
+    }
+    generated = true;
+
+FINALLY:
+    clearWorkspace(&local);
+    return generated;
+}
+
+/**
+ * Each room is unseen, on the frontier of the maze, or in the maze. The rooms
+ * on the frontier are kept in an array in no order, a random one of them being
+ * swapped out with the last each time.
+ */
+bool Generator_generatePrim(Maze maze, Room room, Workspace workspace, struct rng *rng)
+{
+    bool generated;
+    int i, j, next, height, width, nfrontier, count, delta[4], directions[4], joins[4];
+    int *frontier;
+    unsigned char *state;
+    struct workspace local;
+
+    generated = false;
+    emptyWorkspace(&local);
+    if (!workspace) workspace = &local;
+    height = Maze_getHeight(maze);
+    width = Maze_getWidth(maze);
+    delta[0] = -width; delta[1] = 1; delta[2] = width; delta[3] = -1;
+    TRY(reserveWorkspace(workspace, (size_t)height * width, (size_t)height * width));
+    frontier = workspace->ints;
+    state = workspace->bytes;
+    memset(state, 0, (size_t)height * width);
+    nfrontier = 1;
+    frontier[0] = Maze_getOffset(maze, room);
+    state[frontier[0]] = 1;
+    while (nfrontier > 0)
+    {
+        i = Rng_below(rng, nfrontier);
+        next = frontier[i];
+        frontier[i] = frontier[--nfrontier];
+        state[next] = 2;
+        count = findNeighbours(next, height, width, directions);
+        for (i = j = 0; i < count; i++)
+        {
+            if (state[next + delta[directions[i]]] == 2) joins[j++] = directions[i];
+            else if (state[next + delta[directions[i]]] == 0)
+            {
+                state[next + delta[directions[i]]] = 1;
+                frontier[nfrontier++] = next + delta[directions[i]];
+            }
+        }
+        if (j > 0) Maze_tunnelAt(maze, next, next + delta[joins[Rng_below(rng, j)]]);
+    }
+    generated = true;
+
+FINALLY:
+    clearWorkspace(&local);
+    return generated;
+}
+
+/**
+ * The walk from each room is kept as the direction last taken out of every room
+ * it passes through, so a walk that comes back to a room it has already been
+ * through simply leaves it the other way, which erases the loop. Once the walk
+ * meets the maze, the directions are followed again from its first room and
+ * carved. The rooms in the maze are marked with a direction of their own.
+ */
+bool Generator_generateWilson(Maze maze, Workspace workspace, struct rng *rng)
+{
+    bool generated;
+    int room, next, after, height, width, nrooms, delta[4], directions[4];
+    unsigned char *walk;
+    struct workspace local;
+
+    generated = false;
+    emptyWorkspace(&local);
+    if (!workspace) workspace = &local;
+    height = Maze_getHeight(maze);
+    width = Maze_getWidth(maze);
+    nrooms = height * width;
+    delta[0] = -width; delta[1] = 1; delta[2] = width; delta[3] = -1;
+    TRY(reserveWorkspace(workspace, 0, nrooms));
+    walk = workspace->bytes;
+    memset(walk, 0, nrooms);
+    walk[Maze_getOffset(maze, Maze_getRandomRoom(maze, rng))] = 4;
+    for (room = 0; room < nrooms; room++)
+    {
+        for (next = room; walk[next] != 4; next += delta[walk[next]])
+            walk[next] = directions[Rng_below(rng, findNeighbours(next, height, width, directions))];
+        for (next = room; walk[next] != 4; next = after)
+        {
+            after = next + delta[walk[next]];
+            Maze_tunnelAt(maze, next, after);
+            walk[next] = 4;
+        }
+    }
+    generated = true;
+
+FINALLY:
+    clearWorkspace(&local);
+    return generated;
+}
+
+/**
+ * Generates a maze with Eller's algorithm, writing each row out as soon as it is
+ * finished. Only one row of rooms is ever held in memory, so the height of the
+ * maze is not limited by memory at all. Each room of a row belongs to a set of
+ * rooms connected through the rows so far; a set is named by one of its rooms
+ * in the row, and sets are merged with a union-find over those names. Rooms in
+ * different sets are joined at random, at least one room of every set is
+ * carried down into the next row, and the last row joins every remaining set.
+ * As with Generator_makeRandomTunnels, about one row in two also gets one extra
+ * tunnel that may close a loop.
+ */
+bool Generator_generateStream(char *filename, int format, int height, int width, struct rng *rng)
+{
+    bool generated, last;
+    int x, y, a, b;
+    int *set, *parent, *count, *first;
+    unsigned char *walls, *down;
+    MazeWriter writer;
+
+    generated = false;
+    set = parent = count = first = NULL;
+    walls = down = NULL;
+    writer = NULL;
+    TRY( (set = malloc(sizeof *set * width)) );
+    TRY( (parent = malloc(sizeof *parent * width)) );
+    TRY( (count = malloc(sizeof *count * width)) );
+    TRY( (first = malloc(sizeof *first * width)) );
+    TRY( (walls = malloc(width)) );
+    TRY( (down = calloc(width, 1)) );
+    TRY( (writer = MazeWriter_open(filename, format, height, width)) );
+    MazeWriter_setStart(writer, Rng_below(rng, height), Rng_below(rng, width));
+    MazeWriter_setFinish(writer, Rng_below(rng, height), Rng_below(rng, width));
+    for (y = 0; y < width; y++) set[y] = y;
+    for (x = 0; x < height; x++)
+    {
+        last = x == height - 1;
+        for (y = 0; y < width; y++)
+        {
+            walls[y] = NORTH + EAST + SOUTH + WEST - (down[y] ? NORTH : 0);
+            parent[y] = y;
+        }
+        for (y = 0; y < width - 1; y++)
+        {
+            a = findSet(parent, set[y]);
+            b = findSet(parent, set[y + 1]);
+            if (a == b || !(last || Rng_below(rng, 2))) continue;
+            parent[a] = b;
+            walls[y] &= ~EAST;
+            walls[y + 1] &= ~WEST;
+        }
+        if (!last && width > 1 && Rng_below(rng, 2))
+        {
+            y = Rng_below(rng, width - 1);
+            parent[findSet(parent, set[y])] = findSet(parent, set[y + 1]);
+            walls[y] &= ~EAST;
+            walls[y + 1] &= ~WEST;
+        }
+        for (y = 0; y < width; y++) count[y] = 0, first[y] = -1;
+        for (y = 0; y < width && !last; y++) count[findSet(parent, set[y])]++;
+        for (y = 0; y < width && !last; y++)
+        {
+            a = findSet(parent, set[y]);
+            count[a]--;
+            down[y] = Rng_below(rng, 2) || (count[a] == 0 && first[a] < 0);
+            if (down[y])
+            {
+                walls[y] &= ~SOUTH;
+                if (first[a] < 0) first[a] = y;
+                set[y] = first[a];
+            }
+            else set[y] = y;
+        }
+        TRY(MazeWriter_writeRow(writer, walls));
+    }
+    generated = true;
+
+FINALLY:
+    generated = MazeWriter_close(&writer) && generated;
+    free(set);
+    free(parent);
+    free(count);
+    free(first);
+    free(walls);
+    free(down);
+    return generated;
+}
+
+void Generator_generateBinaryTree(Maze maze, struct rng *rng)
+{
+    int x, y, room, width;
+
+    width = Maze_getWidth(maze);
+    for (x = room = 0; x < Maze_getHeight(maze); x++)
+        for (y = 0; y < width; y++, room++)
+        {
+            if (x > 0 && (y == 0 || Rng_below(rng, 2))) Maze_tunnelAt(maze, room, room - width);
+            else if (y > 0) Maze_tunnelAt(maze, room, room - 1);
+        }
+}
+
+void Generator_generateSidewinder(Maze maze, struct rng *rng)
+{
+    int x, y, room, run, chosen, width;
+
+    width = Maze_getWidth(maze);
+    for (x = room = 0; x < Maze_getHeight(maze); x++)
+        for (y = run = 0; y < width; y++, room++)
+        {
+            if (x > 0 && (y == width - 1 || Rng_below(rng, 2)))
+            {
+                /* close the run, joining one of its rooms to the row above */
+                chosen = room - Rng_below(rng, y - run + 1);
+                Maze_tunnelAt(maze, chosen, chosen - width);
+                run = y + 1;
+            }
+            else if (y < width - 1) Maze_tunnelAt(maze, room, room + 1);
+        }
+}
+
+/**
+ * Finds the directions out of a room that stay within the maze, numbered 0 for
+ * north to 3 for west.
+ *
+ * \return The number of directions found.
+ */
+int findNeighbours(int room, int height, int width, int *directions)
+{
+    int count;
+
+    count = 0;
+    if (room >= width) directions[count++] = 0;
+    if (room % width < width - 1) directions[count++] = 1;
+    if (room < (height - 1) * width) directions[count++] = 2;
+    if (room % width > 0) directions[count++] = 3;
+    return count;
+}
+
+int findSet(int *parent, int set)
+{
+    while (parent[set] != set)
+    {
+        parent[set] = parent[parent[set]];
+        set = parent[set];
+    }
+    return set;
+}
+
+void shuffleRoomArray(int *array, int size, struct rng *rng)
+{
+    int i, chosen, temp;
+
+    for (i = 0; i < size - 1; i++)
+    {
+        chosen = i + Rng_below(rng, size - i);
+        temp = array[i];
+        array[i] = array[chosen];
+        array[chosen] = temp;
+    }
+}
+
+void Generator_makeRandomTunnels(Maze maze, int ntunnels, struct rng *rng)
+{
+    int tunnels, nadjacent, randomRoom, adjacent[4];
+
+    tunnels = 0;
+    do
+    {
+        randomRoom = Maze_getOffset(maze, Maze_getRandomRoom(maze, rng));
+        nadjacent = Maze_getAdjacentAt(maze, randomRoom, adjacent, true);
+        if (nadjacent > 1) shuffleRoomArray(adjacent, nadjacent, rng);
+        if (nadjacent > 0) Maze_tunnelAt(maze, randomRoom, adjacent[0]), tunnels++;
+    } while (tunnels < ntunnels);
+}
+
+#undef NORTH
+#undef EAST
+#undef SOUTH
+#undef WEST
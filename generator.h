@@ -0,0 +1,243 @@
+/**
+ * \file generator.h
+ *
+ * Maze generators. Each of them carves a maze that is a spanning tree of its
+ * rooms, so that there is exactly one path between any two rooms, and then
+ * adds a few tunnels at random so that some mazes have loops.
+ */
+
+#ifndef GENERATOR_HEADER
+#define GENERATOR_HEADER
+
+#include <stddef.h>
+
+#include "bool.h"
+#include "maze.h"
+
+/**
+ * The algorithms Generator_carve can carve a maze with.
+ */
+#define Generator_backtrack 0
+#define Generator_kruskal 1
+#define Generator_prim 2
+#define Generator_wilson 3
+#define Generator_binary 4
+#define Generator_sidewinder 5
+
+/**
+ * The memory the generators work in besides the maze itself: the stack and the
+ * visited rooms of the recursive backtracker, and the arrays of Kruskal's,
+ * Prim's and Wilson's algorithms. A thread that generates maze after maze can
+ * keep one workspace and pass it to every carve, so that it is only allocated
+ * for the first maze and grown for a larger one. Each workspace must only be
+ * used by one thread at a time.
+ */
+typedef struct workspace *Workspace;
+
+/**
+ * Creates an empty workspace, which allocates nothing until a maze is carved in
+ * it.
+ *
+ * \return A new workspace, or NULL if there was not enough memory.
+ */
+Workspace Workspace_new(void);
+
+/**
+ * Frees a workspace, and all the memory it holds, and sets it to NULL.
+ *
+ * \param this The workspace to free.
+ */
+void Workspace_free(Workspace *this);
+
+/**
+ * Generates a whole maze the way maze-gen does: fills a new maze, carves it
+ * with the algorithm given (on several threads if asked and the algorithm
+ * allows), opens height / 2 random tunnels, and picks a random start and finish
+ * room. The same arguments always give the same maze, on any platform.
+ *
+ * \param height The height of the maze, in rooms.
+ * \param width The width of the maze, in rooms.
+ * \param packed Whether to keep the walls of the maze packed two rooms to a
+ *     byte, as Maze_newPacked does.
+ * \param algorithm The algorithm to carve the maze with, as Generator_carve
+ *     takes.
+ * \param threads The number of threads to carve the maze on.
+ * \param maxbytes The most memory the stack of each carving thread may use, or
+ *     0 for no limit.
+ * \param seed The seed of the maze.
+ *
+ * \return A new maze, or NULL if there was not enough memory.
+ */
+Maze Generator_newMaze(int height, int width, bool packed, int algorithm, int threads, size_t maxbytes,
+    unsigned long seed);
+
+/**
+ * Carves a whole maze into a maze that has every wall standing, as
+ * Generator_newMaze does, so that a maze refilled with Maze_refill can be
+ * generated again without allocating a new one.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param algorithm The algorithm to carve the maze with, as Generator_carve
+ *     takes.
+ * \param threads The number of threads to carve the maze on.
+ * \param maxbytes The most memory the stack of each carving thread may use, or
+ *     0 for no limit.
+ * \param workspace The workspace to carve in, or NULL to allocate one for this
+ *     maze alone.
+ * \param rng The random number generator to draw the maze from.
+ *
+ * \return true if the maze was carved, false if not.
+ */
+bool Generator_carveMaze(Maze maze, int algorithm, int threads, size_t maxbytes, Workspace workspace,
+    struct rng *rng);
+
+/**
+ * Carves a spanning tree into a maze that has every wall standing, with one of
+ * the algorithms below, without opening any further tunnels. Only the recursive
+ * backtracker can carve on several threads; the others always carve on one.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param algorithm One of Generator_backtrack, Generator_kruskal,
+ *     Generator_prim, Generator_wilson, Generator_binary or
+ *     Generator_sidewinder.
+ * \param threads The number of threads to carve the maze on.
+ * \param maxbytes The most memory the stack of each backtracking thread may use,
+ *     or 0 for no limit.
+ * \param workspace The workspace to carve in, or NULL to allocate one for this
+ *     maze alone.
+ *     The backtracker only carves in it on one thread.
+ * \param rng The random number generator to draw the maze from.
+ *
+ * \return true if the maze was carved, false if the algorithm is not known or
+ *     there was not enough memory.
+ */
+bool Generator_carve(Maze maze, int algorithm, int threads, size_t maxbytes, Workspace workspace,
+    struct rng *rng);
+
+/**
+ * Carves a maze with a recursive backtracker. The recursion is kept on a stack
+ * of its own rather than the call stack, so the depth of the maze is limited
+ * only by memory.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param room The room to start carving from.
+ * \param maxbytes The most memory the stack may use, or 0 for no limit.
+ * \param workspace The workspace to carve in, or NULL to allocate one for this
+ *     maze alone.
+ * \param rng The random number generator to draw the order the rooms are
+ *     carved in from.
+ *
+ * \return true if the maze was carved, false if the stack ran out of memory.
+ */
+bool Generator_generateFrom(Maze maze, Room room, size_t maxbytes, Workspace workspace, struct rng *rng);
+
+/**
+ * Carves a maze on several threads at once, each carving a band of whole rows
+ * with a recursive backtracker, and then joins every band to the next.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param ntiles The number of bands, and of threads.
+ * \param maxbytes The most memory the stack of each thread may use, or 0 for
+ *     no limit.
+ * \param rng The random number generator to draw the maze from. Each band is
+ *     given a generator of its own split from it before any thread starts, so
+ *     the same seed and number of bands always give the same maze.
+ *
+ * \return true if the maze was carved, false if not.
+ */
+bool Generator_generateTiled(Maze maze, int ntiles, size_t maxbytes, struct rng *rng);
+
+/**
+ * Carves a maze with Kruskal's algorithm: every wall between two rooms is taken
+ * once, in a random order, and broken if the rooms on either side of it are not
+ * yet joined, which a union-find over the rooms in a flat array tells. The
+ * maze has many short dead ends.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param workspace The workspace to carve in, or NULL to allocate one for this
+ *     maze alone.
+ * \param rng The random number generator to draw the order of the walls from.
+ *
+ * \return true if the maze was carved, false if there was not enough memory.
+ */
+bool Generator_generateKruskal(Maze maze, Workspace workspace, struct rng *rng);
+
+/**
+ * Carves a maze with a randomised Prim's algorithm: the maze grows from one room,
+ * each time joining a random room next to it to a random room of it. The maze
+ * has many short dead ends branching off paths that run out from the first room.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param room The room to grow the maze from.
+ * \param workspace The workspace to carve in, or NULL to allocate one for this
+ *     maze alone.
+ * \param rng The random number generator to draw the rooms from.
+ *
+ * \return true if the maze was carved, false if there was not enough memory.
+ */
+bool Generator_generatePrim(Maze maze, Room room, Workspace workspace, struct rng *rng);
+
+/**
+ * Carves a maze with Wilson's algorithm, which draws every spanning tree of the
+ * rooms with the same chance. Starting from a maze of one random room, a random
+ * walk is taken from each room not yet in the maze until it meets the maze, and
+ * the walk, with its loops erased, is carved. The first walks are long, so the
+ * algorithm is slow to start on large mazes.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param workspace The workspace to carve in, or NULL to allocate one for this
+ *     maze alone.
+ * \param rng The random number generator to draw the walks from.
+ *
+ * \return true if the maze was carved, false if there was not enough memory.
+ */
+bool Generator_generateWilson(Maze maze, Workspace workspace, struct rng *rng);
+
+/**
+ * Carves a maze as a binary tree: every room is joined to the room north or west
+ * of it, whichever a coin toss picks. The rooms are carved in order, one pass
+ * over the maze, without any memory of its own. The first row and the first
+ * column are each a single corridor, and every path runs north-west.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param rng The random number generator to toss the coins with.
+ */
+void Generator_generateBinaryTree(Maze maze, struct rng *rng);
+
+/**
+ * Carves a maze with the sidewinder algorithm: each row is cut into runs of
+ * rooms joined east to west, and each run is joined north by one random room of
+ * it. The rooms are carved in order, one pass over the maze, without any memory
+ * of its own. The first row is a single corridor, and there are no dead ends
+ * facing north.
+ *
+ * \param maze The maze to carve, with every wall standing.
+ * \param rng The random number generator to draw the runs from.
+ */
+void Generator_generateSidewinder(Maze maze, struct rng *rng);
+
+/**
+ * Generates a maze with Eller's algorithm straight into a file, one row at a
+ * time, so that the maze is never held in memory.
+ *
+ * \param filename The file to write, or "-" for the standard output.
+ * \param format The format to write, Maze_formatText, Maze_formatBinary or
+ *     Maze_formatCompressed.
+ * \param height The height of the maze, in rooms.
+ * \param width The width of the maze, in rooms.
+ * \param rng The random number generator to draw the maze from.
+ *
+ * \return true if the whole maze was written, false if not.
+ */
+bool Generator_generateStream(char *filename, int format, int height, int width, struct rng *rng);
+
+/**
+ * Opens tunnels through random walls of a maze, which may close loops.
+ *
+ * \param maze The maze to open tunnels in.
+ * \param ntunnels The number of tunnels to open.
+ * \param rng The random number generator to draw the tunnels from.
+ */
+void Generator_makeRandomTunnels(Maze maze, int ntunnels, struct rng *rng);
+
+#endif /* GENERATOR_HEADER */
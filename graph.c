@@ -0,0 +1,68 @@
+#include <stdlib.h>
+
+#include "bool.h"
+#include "try.h"
+#include "maze.h"
+#include "graph.h"
+
+#define NORTH 1
+#define EAST  2
+#define SOUTH 4
+#define WEST  8
+
+Graph Graph_new(Maze maze)
+{
+    bool built;
+    int x, y, room, mask, direction, step[4];
+    Graph this;
+
+    built = false;
+    TRY( (this = malloc(sizeof *this)) );
+    this->height = Maze_getHeight(maze);
+    this->width = Maze_getWidth(maze);
+    this->nrooms = this->height * this->width;
+    TRY( (this->passages = malloc(this->nrooms)) );
+
+    /* the directions are taken in the same order as Maze_getAdjacent takes them */
+    step[0] = -this->width; step[1] = 1; step[2] = this->width; step[3] = -1;
+    for (mask = 0; mask < 16; mask++)
+    {
+        this->counts[mask] = 0;
+        for (direction = 0; direction < 4; direction++)
+            if (mask & (1 << direction)) this->offsets[mask][this->counts[mask]++] = step[direction];
+    }
+    for (room = x = 0; x < this->height; x++)
+        for (y = 0; y < this->width; y++, room++)
+        {
+            mask = ~Maze_getWallsAt(maze, room) & (NORTH + EAST + SOUTH + WEST);
+            if (x == 0) mask &= ~NORTH;
+            if (y == this->width - 1) mask &= ~EAST;
+            if (x == this->height - 1) mask &= ~SOUTH;
+            if (y == 0) mask &= ~WEST;
+            this->passages[room] = mask;
+        }
+    for (room = 0; room < this->nrooms; room++)
+    {
+        if (Maze_getMarkerAt(maze, room) != Room_deadend) continue;
+        for (mask = this->passages[room], direction = 0; direction < 4; direction++)
+            if (mask & (1 << direction))
+                this->passages[room + step[direction]] &= ~(1 << ((direction + 2) & 3));
+    }
+    built = true;
+
+FINALLY:
+    if (!built) Graph_free(&this);
+    return this;
+}
+
+void Graph_free(Graph *this)
+{
+    if (*this) free((*this)->passages);
+    free(*this);
+    *this = NULL;
+}
+
+#undef NORTH
+#undef EAST
+#undef SOUTH
+#undef WEST
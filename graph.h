@@ -0,0 +1,54 @@
+/**
+ * \file graph.h
+ *
+ * A read-only view of the passages of a maze, built once so that searches can
+ * step from room to room without going through Maze_getAdjacent. Each room is
+ * known by its offset in the maze, and keeps a mask of the directions it has
+ * passages in; the offsets to add to a room to reach its neighbours are kept
+ * once for each of the 16 masks. Stepping to a neighbour therefore costs two
+ * table lookups and an addition, with no division and no bounds checks.
+ */
+
+#ifndef GRAPH_HEADER
+#define GRAPH_HEADER
+
+#include "maze.h"
+
+/**
+ * The view itself. Its members are left open so that the searches can read
+ * them directly in their innermost loops:
+ *
+ *     mask = graph->passages[room];
+ *     for (i = 0; i < graph->counts[mask]; i++)
+ *         next = room + graph->offsets[mask][i];
+ */
+struct mazegraph
+{
+    int height, width, nrooms;
+    unsigned char *passages;
+    int counts[16];
+    int offsets[16][4];
+};
+
+typedef struct mazegraph *Graph;
+
+/**
+ * Builds the view of a maze as it is now; later changes to the maze are not
+ * seen. Passages leading out of the maze, or into a room marked as a dead end,
+ * are left out, so a maze pruned by Solver_prune is searched as though its dead
+ * ends were walled off.
+ *
+ * \param maze The maze to view.
+ *
+ * \return A new view, or NULL if there was not enough memory.
+ */
+Graph Graph_new(Maze maze);
+
+/**
+ * Frees a view and sets it to NULL.
+ *
+ * \param this The view to free.
+ */
+void Graph_free(Graph *this);
+
+#endif /* GRAPH_HEADER */
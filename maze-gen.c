@@ -1,39 +1,105 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #define DEBUG
 
 #include "bool.h"
 #include "try.h"
 #include "maze.h"
+#include "generator.h"
 
 #define DEFAULTSIZE 10
+#define MAXTHREADS 256
+
+/**
+ * The names -algo takes, indexed by the algorithms of Generator_carve.
+ */
+char *algorithms[] = {"backtrack", "kruskal", "prim", "wilson", "binary", "sidewinder", NULL};
 
-void generateFrom(Maze maze, Room room);
-void shuffleRoomArray(Room *array, int size);
-void makeRandomTunnels(Maze maze, int nwalls);
-void parseArguments(int argc, char **argv, int *height, int *width, char *filename);
+/**
+ * The options maze-gen was run with. If count is not 0, that many mazes are
+ * written into the directory out instead of one maze into filename.
+ */
+struct options
+{
+    int height, width, format, algorithm, threads, count;
+    bool packed, stream;
+    unsigned long seed;
+    size_t maxbytes;
+    char filename[256], out[256];
+};
+
+/**
+ * A batch of mazes generated by a pool of threads, each taking the number of
+ * the next maze in turn along with a random number generator split from rng
+ * for it, so that every maze depends only on the seed and its number however
+ * the threads are scheduled.
+ */
+struct batch
+{
+    struct options *options;
+    struct rng rng;
+    int next, generated, digits;
+    bool failed;
+    pthread_mutex_t lock;
+};
+
+bool generateBatch(struct options *options);
+void *batchThread(void *batch);
+double getTime(void);
+bool parseArguments(int argc, char **argv, struct options *options);
 
 int main(int argc, char **argv)
 {
     bool generated;
-    int height, width;
-    char filename[256];
+    double start, elapsed, rooms;
+    struct options options;
+    struct rng rng;
     Maze myMaze;
 
     generated = EXIT_FAILURE;
-    height = width = DEFAULTSIZE;
-    strcpy(filename, "-");
-    parseArguments(argc, argv, &height, &width, filename);
-    TRY( (myMaze = Maze_newFilled(height, width)) );
-    srand(time(NULL));
-    generateFrom(myMaze, Maze_getRandomRoom(myMaze));
-    makeRandomTunnels(myMaze, height/2);
-    Maze_setStart(myMaze, Maze_getRandomRoom(myMaze));
-    Maze_setFinish(myMaze, Maze_getRandomRoom(myMaze));
-    TRY(Maze_export(myMaze, filename));
+    myMaze = NULL;
+    options.height = options.width = DEFAULTSIZE;
+    options.format = Maze_formatText;
+    options.algorithm = Generator_backtrack;
+    options.threads = 1;
+    options.count = 0;
+    options.packed = options.stream = false;
+    options.seed = time(NULL);
+    options.maxbytes = 0;
+    strcpy(options.filename, "-");
+    strcpy(options.out, ".");
+    TRY(parseArguments(argc, argv, &options));
+    TRY(options.algorithm >= 0);
+    if (options.count > 0)
+    {
+        TRY(generateBatch(&options));
+        generated = EXIT_SUCCESS;
+        goto FINALLY;
+    }
+    if (options.stream)
+    {
+        Rng_seed(&rng, options.seed);
+        TRY(Generator_generateStream(options.filename, options.format, options.height, options.width,
+            &rng));
+        generated = EXIT_SUCCESS;
+        goto FINALLY;
+    }
+    start = getTime();
+    TRY( (myMaze = Generator_newMaze(options.height, options.width, options.packed, options.algorithm,
+        options.threads, options.maxbytes, options.seed)) );
+    elapsed = getTime() - start;
+    rooms = (double)options.height * options.width;
+    fprintf(stderr, "Generated %.0f rooms with %s in %.3f s: %.0f rooms/s\n", rooms,
+        algorithms[options.algorithm], elapsed, elapsed > 0 ? rooms / elapsed : 0);
+    Maze_setFormat(myMaze, options.format);
+    TRY(Maze_export(myMaze, options.filename));
     generated = EXIT_SUCCESS;
 
 FINALLY:
@@ -41,63 +107,180 @@ FINALLY:
     return generated;
 }
 
-void generateFrom(Maze maze, Room room)
+/**
+ * Generates options->count mazes into the directory options->out, named by
+ * their numbers, on a pool of options->threads threads, and reports how many
+ * were generated per second on the standard error stream.
+ */
+bool generateBatch(struct options *options)
 {
-    int i, size;
-    Room adjacent[4];
-
-    Maze_setMarker(room, Room_visited);
-    size = Maze_getAdjacent(maze, room, adjacent, true);
-    if (size > 1) shuffleRoomArray(adjacent, size);
-    for (i = 0; i < size; i++)
-        if (Maze_getMarker(adjacent[i]) == Room_cleared)
-        {
-            generateFrom(maze, adjacent[i]);
-            Maze_tunnel(maze, room, adjacent[i]);
-        }
+    bool generated, locked;
+    int i, nthreads;
+    double start, elapsed, rooms;
+    struct batch batch;
+    pthread_t workers[MAXTHREADS];
+
+    generated = locked = false;
+    nthreads = 0;
+    batch.options = options;
+    Rng_seed(&batch.rng, options->seed);
+    batch.next = batch.generated = 0;
+    batch.failed = false;
+    for (batch.digits = 1, i = options->count - 1; i >= 10; i /= 10) batch.digits++;
+    mkdir(options->out, 0777);
+    TRY( (locked = pthread_mutex_init(&batch.lock, NULL) == 0) );
+    start = getTime();
+    for (nthreads = 0; nthreads < options->threads - 1 && nthreads < MAXTHREADS - 1; nthreads++)
+        TRY(pthread_create(&workers[nthreads], NULL, batchThread, &batch) == 0);
+    batchThread(&batch);
+    generated = true;
+
+FINALLY:
+    for (i = 0; i < nthreads; i++) pthread_join(workers[i], NULL);
+    if (generated)
+    {
+        elapsed = getTime() - start;
+        rooms = (double)batch.generated * options->height * options->width;
+        fprintf(stderr, "Generated %i mazes of %.0f rooms in %.3f s: %.1f mazes/s, %.0f rooms/s\n",
+            batch.generated, rooms, elapsed, elapsed > 0 ? batch.generated / elapsed : 0,
+            elapsed > 0 ? rooms / elapsed : 0);
+    }
+    if (locked) pthread_mutex_destroy(&batch.lock);
+    return generated && !batch.failed;
 }
 
-void shuffleRoomArray(Room *array, int size)
+/**
+ * Generates mazes of a batch until there are none left. Each thread keeps a
+ * single maze that it refills for every maze it generates, and a workspace that
+ * every maze is carved in, so that nothing the size of a maze is allocated
+ * after the first; only writing each file allocates its stream and a few rows.
+ * Streamed mazes keep nothing from one to the next.
+ */
+void *batchThread(void *batch)
 {
-    int i, chosen;
-    Room temp;
+    bool written;
+    int i;
+    char filename[300];
+    struct batch *this;
+    struct options *options;
+    struct rng rng;
+    Maze maze;
+    Workspace workspace;
 
-    for (i = 0; i < size - 1; i++)
+    this = batch;
+    options = this->options;
+    maze = NULL;
+    /* without a workspace, each maze is carved in memory of its own */
+    workspace = Workspace_new();
+    for (;;)
     {
-        chosen = i + (rand() % (size - i));
-        temp = array[i];
-        array[i] = array[chosen];
-        array[chosen] = temp;
+        pthread_mutex_lock(&this->lock);
+        i = this->next++;
+        if (i < options->count) Rng_split(&this->rng, &rng);
+        pthread_mutex_unlock(&this->lock);
+        if (i >= options->count) break;
+        sprintf(filename, "%s/maze-%0*i.%s", options->out, this->digits, i,
+            options->format == Maze_formatBinary ? "mzb" : options->format == Maze_formatCompressed ? "mzc" : "mdf");
+        if (options->stream)
+            written = Generator_generateStream(filename, options->format, options->height,
+                options->width, &rng);
+        else
+        {
+            if (!maze && (maze = options->packed ? Maze_newPacked(options->height, options->width)
+                : Maze_newFilled(options->height, options->width)))
+                Maze_setFormat(maze, options->format);
+            else if (maze && !Maze_refill(maze, options->height, options->width))
+                Maze_free(&maze);
+            written = maze
+                && Generator_carveMaze(maze, options->algorithm, 1, options->maxbytes, workspace, &rng)
+                && Maze_export(maze, filename);
+        }
+
+        pthread_mutex_lock(&this->lock);
+        if (written) this->generated++;
+        else
+        {
+            fprintf(stderr, "%s: cannot be written\n", filename);
+            this->failed = true;
+        }
+        pthread_mutex_unlock(&this->lock);
     }
+    Maze_free(&maze);
+    Workspace_free(&workspace);
+    return NULL;
 }
 
-void makeRandomTunnels(Maze maze, int ntunnels)
+double getTime(void)
 {
-    int tunnels, nadjacent;
-    Room randomRoom, adjacent[4];
+    struct timespec now;
 
-    tunnels = 0;
-    do
-    {
-        randomRoom = Maze_getRandomRoom(maze);
-        nadjacent = Maze_getAdjacent(maze, randomRoom, adjacent, true);
-        if (nadjacent > 1) shuffleRoomArray(adjacent, nadjacent);
-        if (adjacent[0]) Maze_tunnel(maze, randomRoom, adjacent[0]), tunnels++;
-    } while (tunnels < ntunnels);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
 }
 
-void parseArguments(int argc, char **argv, int *height, int *width, char *filename)
+/**
+ * Reads the options maze-gen was run with. Anything not starting with - is taken
+ * as the file to write, so that a mistyped option is never written to as one.
+ *
+ * \return false if an option is unknown or -threads asks for more threads than
+ *     can be used.
+ */
+bool parseArguments(int argc, char **argv, struct options *options)
 {
-    int i;
+    int i, j;
 
     for (i = 1; i < argc; i++)
     {
         if (strcmp("-h", argv[i]) == 0 && argv[++i])
-            *height = strtol(argv[i], NULL, 0);
+            options->height = strtol(argv[i], NULL, 0);
         else if (strcmp("-w", argv[i]) == 0 && argv[++i])
-            *width = strtol(argv[i], NULL, 0);
-        else strcpy(filename, argv[i]);
+            options->width = strtol(argv[i], NULL, 0);
+        else if (strcmp("-m", argv[i]) == 0 && argv[++i])
+            options->maxbytes = strtoul(argv[i], NULL, 0) << 20;
+        else if (strcmp("-threads", argv[i]) == 0 && argv[++i])
+        {
+            options->threads = strtol(argv[i], NULL, 0);
+            if (options->threads > MAXTHREADS)
+            {
+                fprintf(stderr, "maze-gen: at most %i threads can be used\n", MAXTHREADS);
+                return false;
+            }
+        }
+        else if (strcmp("-algo", argv[i]) == 0 && argv[++i])
+        {
+            for (j = 0; algorithms[j] && strcmp(algorithms[j], argv[i]) != 0; j++);
+            if (!algorithms[j]) fprintf(stderr, "maze-gen: unknown algorithm %s\n", argv[i]);
+            options->algorithm = algorithms[j] ? j : -1;
+        }
+        else if (strcmp("-seed", argv[i]) == 0 && argv[++i])
+            options->seed = strtoul(argv[i], NULL, 0);
+        else if (strcmp("-binary", argv[i]) == 0)
+            options->format = Maze_formatBinary;
+        else if (strcmp("-compressed", argv[i]) == 0)
+            options->format = Maze_formatCompressed;
+        else if (strcmp("-packed", argv[i]) == 0)
+            options->packed = true;
+        else if (strcmp("-stream", argv[i]) == 0)
+            options->stream = true;
+        else if (strcmp("-count", argv[i]) == 0 && argv[++i])
+            options->count = strtol(argv[i], NULL, 0);
+        else if (strcmp("-out", argv[i]) == 0 && argv[++i])
+        {
+            strncpy(options->out, argv[i], sizeof options->out - 1);
+            options->out[sizeof options->out - 1] = '\0';
+        }
+        else if (argv[i][0] == '-' && argv[i][1])
+        {
+            fprintf(stderr, "maze-gen: unknown option %s\n", argv[i]);
+            return false;
+        }
+        else
+        {
+            strncpy(options->filename, argv[i], sizeof options->filename - 1);
+            options->filename[sizeof options->filename - 1] = '\0';
+        }
     }
-    if (!*width) *width = DEFAULTSIZE;
-    if (!*height) *height = DEFAULTSIZE;
+    if (!options->width) options->width = DEFAULTSIZE;
+    if (!options->height) options->height = DEFAULTSIZE;
+    return true;
 }
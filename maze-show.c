@@ -10,17 +10,18 @@
 int main(int argc, char **argv)
 {
     bool printed;
-    Maze myMaze;
+    MazeReader myReader;
 
     printed = EXIT_FAILURE;
-    TRY( (myMaze = Maze_new()) );
+    myReader = NULL;
 
     TRY(argc > 1);
-    TRY(Maze_import(myMaze, argv[1]));
-    Maze_print(myMaze);
+    TRY( (myReader = MazeReader_open(argv[1])) );
+    TRY(MazeReader_print(myReader, stdout));
     printed = EXIT_SUCCESS;
 
 FINALLY:
-    Maze_free(&myMaze);
+    fflush(stdout);
+    MazeReader_close(&myReader);
     return printed;
 }
@@ -1,12 +1,53 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 
 #define DEBUG
 
 #include "bool.h"
 #include "try.h"
 #include "maze.h"
+#include "bitboard.h"
+#include "solver.h"
+
+#define MAXTHREADS 256
+#define QUERYCHUNK 4096
+#define DEFAULTFPS 30
+#define PLAYSTACK 1024
+
+/**
+ * The options maze-solve was run with. The files named on the command line are
+ * kept in files for -batch; the last of them is also the filename solved
+ * otherwise.
+ */
+struct options
+{
+    bool shortest, all, count, batch, prune, serve, index, edit, play;
+    int format, threads, nfiles, algorithm, fps;
+    char **files;
+    char filename[256];
+};
+
+/**
+ * A batch of maze files solved by a pool of threads, each taking the next file
+ * in turn and printing a line for it once it is solved.
+ */
+struct batch
+{
+    char **files;
+    int nfiles, next, format, algorithm, solved;
+    bool prune;
+    double rooms;
+    pthread_mutex_t lock;
+};
 
 /**
  * Solves the maze from a given start room.
@@ -23,67 +64,269 @@ bool solveFrom(Maze maze, Room room);
  *
  * \param maze The maze to solve.
  * \param room The room to start from.
+ * \param found The number of solutions found before this room was reached.
  *
- * \return The number of solutions found.
+ * \return The number of solutions found, including those found before.
+ */
+int solveAll(Maze maze, Room room, int found);
+
+/**
+ * The state of a step-by-step solution being played back: the time between
+ * frames (0 for no limit), the time the next frame is due, the block of rooms
+ * shown on the terminal (the first row and column of it, and how many of each
+ * fit), and the number of steps played, of times the block was moved and of
+ * characters written so far.
  */
-int solveAll(Maze maze, Room room);
+struct player
+{
+    double interval, due;
+    int top, left, nrows, ncols, steps, moves;
+    long written;
+};
 
 /**
- * Finds the shortest solution to the maze. The starting depth should be 0 when
- * calling the function. If the depth passed/returned is 0, it can be assumed
- * that there was no solution to the maze found.
+ * A room on the stack of the solution being played back, and the index of the
+ * next room adjacent to it to try.
+ */
+struct step
+{
+    Room room;
+    int next;
+};
+
+/**
+ * Plays back the step-by-step solution of a maze at a steady frame rate. The
+ * maze is printed once, then only the rooms whose marker changes are redrawn,
+ * one step to a frame, so the output grows with the number of steps taken
+ * rather than the size of the maze. If the maze does not fit on the terminal,
+ * only as many rooms as fit are shown, and the block shown is moved to centre
+ * on the solver whenever it steps out of it. The number of steps, the time
+ * taken and the number of characters written are printed on the standard error
+ * stream once the solution is found.
  *
  * \param maze The maze to solve.
- * \param room The room to start from.
- * \param depth The starting depth.
- * \param shortMaze An initialized maze that will hold a snapshot of the maze
- *     solved with the shortest path.
+ * \param fps The number of steps to play each second, or 0 for no limit.
+ *
+ * \return 1 if the maze has a solution, 0 if not, or -1 if there was not
+ *     enough memory.
+ */
+int playMaze(Maze maze, int fps);
+int playFrom(Maze maze, Room room, struct player *player);
+bool playRoom(Maze maze, Room room, struct player *player);
+void fitTerminal(Maze maze, struct player *player);
+bool isShown(Maze maze, Room room, struct player *player);
+void showRegion(Maze maze, Room room, struct player *player);
+void redrawRoom(Maze maze, Room room, struct player *player);
+void waitFrame(struct player *player);
+
+/**
+ * Tells whether the finish room of a maze can be reached from its start room at
+ * all, by flooding the bit planes of the maze, which is much quicker than any of
+ * the searches, so that a maze without a solution is never searched in full.
+ *
+ * \param maze The maze to check.
+ *
+ * \return 1 if the finish can be reached, 0 if not, or -1 if there was not
+ *     enough memory.
+ */
+int isSolvable(Maze maze);
+
+/**
+ * Solves every maze named on the command line, or found in a directory named on
+ * the command line, on a pool of threads. One line is printed for each maze,
+ * and the number of mazes and rooms solved per second once they are all done.
+ *
+ * \param options The options holding the files and the number of threads.
+ *
+ * \return true if the files could all be listed, false if not.
+ */
+bool solveBatch(struct options *options);
+
+/**
+ * A query read by -serve, and its answer: the length of the path between the
+ * rooms (-1 if there is none, or the query could not be read), the path itself,
+ * and the time it took to answer.
+ */
+struct query
+{
+    int from, to, length, npath;
+    int *path;
+    double seconds;
+};
+
+/**
+ * The queries read by -serve and not yet answered, shared by a pool of threads
+ * each taking the next query in turn. The view of the maze, and its index if it
+ * has one, are only read, so every thread shares them.
+ */
+struct server
+{
+    Graph graph;
+    TreeIndex index;
+    int algorithm, nqueries, next;
+    struct query *queries;
+    pthread_mutex_t lock;
+};
+
+/**
+ * A thread answering queries, with a search of its own.
+ */
+struct worker
+{
+    struct server *server;
+    Search search;
+};
+
+/**
+ * Answers queries read from the standard input, one per line, each holding the
+ * coordinates of a start room and a finish room, until there are none left. The
+ * answers are printed in the order the queries were read. The queries are read
+ * and answered in chunks, each chunk on a pool of threads; with one thread each
+ * query is answered as soon as it is read. The number of queries answered per
+ * second and percentiles of the time taken to answer them are printed once all
+ * are answered.
+ *
+ * \param maze The maze to answer queries about.
+ * \param options The options holding the number of threads, the search to use,
+ *     and whether to index the maze.
  *
- * \return The depth of the shortest solution (length of the shortest path).
+ * \return true if every query was answered, false if there was not enough
+ *     memory.
  */
-int solveShort(Maze maze, Room room, int depth, Maze shortMaze);
+bool serveQueries(Maze maze, struct options *options);
+void *serveThread(void *worker);
+void printLatencies(double *latencies, int nlatencies, double elapsed);
+int compareDoubles(const void *first, const void *second);
+
+/**
+ * Applies edits read from the standard input to a maze, one per line, each
+ * either "tunnel" or "wall" followed by the coordinates of two adjacent rooms,
+ * and prints the shortest solution once before the first edit and again after
+ * each. The distance of every room from the finish is kept up to date as the
+ * walls change, so each edit only costs as much as the distances it changes.
+ * The time taken and the number of rooms repaired per edit are printed once all
+ * are applied.
+ *
+ * \param maze The maze to edit.
+ *
+ * \return true if every edit was applied or skipped, false if there was not
+ *     enough memory.
+ */
+bool editMaze(Maze maze);
+void printPath(int length, int *path, int npath, int width);
+bool listFiles(char **names, int nnames, char ***files, int *nfiles);
+bool addFile(char *name, char ***files, int *nfiles, int *size);
+void *solveThread(void *batch);
+double getTime(void);
 
 /* argument parsing */
-bool parseArguments(int argc, char **argv, bool *shortest, bool *all, char *filename);
+bool parseArguments(int argc, char **argv, struct options *options);
 void printHelp(void);
 
 int main(int argc, char **argv)
 {
-    bool status, optshort, optall;
-    char filename[256];
+    bool status;
+    struct options options;
     Maze myMaze;
 
     status = EXIT_FAILURE;
-    optshort = optall = false;
-    strcpy(filename, "-");
+    options.shortest = options.all = options.count = options.batch = options.prune = false;
+    options.serve = options.index = options.edit = options.play = false;
+    options.format = Maze_formatAuto;
+    options.fps = DEFAULTFPS;
+    options.threads = 1;
+    options.nfiles = 0;
+    options.algorithm = Solver_bfs;
+    strcpy(options.filename, "-");
     myMaze = Maze_new();
 
-    TRY( (parseArguments(argc, argv, &optshort, &optall, filename)) );
+    TRY( (options.files = malloc(sizeof *options.files * argc)) );
+    TRY( (parseArguments(argc, argv, &options)) );
     TRY(myMaze);
     TRY(argc > 1);
-    TRY(Maze_import(myMaze, filename));
-    if (optall)
+    if (options.batch)
+    {
+        TRY(solveBatch(&options));
+        status = EXIT_SUCCESS;
+        goto FINALLY;
+    }
+    TRY(Maze_importAs(myMaze, options.filename, options.format));
+    if (options.serve)
+    {
+        TRY(serveQueries(myMaze, &options));
+        status = EXIT_SUCCESS;
+        goto FINALLY;
+    }
+    if (options.edit)
+    {
+        TRY(editMaze(myMaze));
+        status = EXIT_SUCCESS;
+        goto FINALLY;
+    }
+    if (options.prune && !options.count)
+    {
+        int pruned;
+
+        TRY( (pruned = Solver_prune(myMaze)) >= 0 );
+        if (!options.all && !options.shortest && !options.play)
+        {
+            puts("Pruned maze:");
+            Maze_print(myMaze);
+            printf("Rooms pruned: %i of %i (%.1f%%)\n", pruned, Maze_getRoomCount(myMaze),
+                100.0 * pruned / Maze_getRoomCount(myMaze));
+            status = EXIT_SUCCESS;
+            goto FINALLY;
+        }
+    }
+    if (!options.count)
+    {
+        int solvable;
+
+        TRY( (solvable = isSolvable(myMaze)) >= 0 );
+        if (!solvable)
+        {
+            puts(options.all ? "Found 0 solutions." : "No solution found.");
+            status = EXIT_SUCCESS;
+            goto FINALLY;
+        }
+    }
+    if (options.count)
+    {
+        char *solutions;
+
+        TRY( (solutions = Solver_countPaths(myMaze, options.threads, true)) );
+        printf("Found %s solutions.\n", solutions);
+        free(solutions);
+    }
+    else if (options.all)
     {
         int solutions;
 
-        solutions = solveAll(myMaze, Maze_getStart(myMaze));
+        solutions = solveAll(myMaze, Maze_getStart(myMaze), 0);
         printf("Found %i solutions.\n", solutions);
     }
-    else if (optshort)
+    else if (options.shortest)
     {
-        Maze shortMaze;
-        int depth;
+        int depth, expanded;
 
-        shortMaze = Maze_new();
-        if ( (depth = solveShort(myMaze, Maze_getStart(myMaze), 0, shortMaze)) )
+        if ( (depth = Solver_findPath(myMaze, options.algorithm, &expanded)) >= 0 )
         {
             puts("Shortest solution:");
-            Maze_print(shortMaze);
+            Maze_replaceMarkers(myMaze, Room_deadend, Room_cleared);
+            Maze_print(myMaze);
             printf("Path length: %i\n", depth);
+            printf("Rooms expanded: %i\n", expanded);
         }
         else puts("No solution found.");
 
     }
+    else if (options.play)
+    {
+        int solved;
+
+        TRY( (solved = playMaze(myMaze, options.fps)) >= 0 );
+        puts(solved ? "Solution found!" : "No solution found.");
+    }
     else if (solveFrom(myMaze, Maze_getStart(myMaze)))
     {
         puts("Solution found!");
@@ -95,9 +338,25 @@ int main(int argc, char **argv)
 
 FINALLY:
     Maze_free(&myMaze);
+    free(options.files);
     return status;
 }
 
+int isSolvable(Maze maze)
+{
+    int solvable;
+    Bitboard bitboard;
+
+    solvable = -1;
+    TRY( (bitboard = Bitboard_new(maze)) );
+    Bitboard_findReachable(bitboard, Maze_getOffset(maze, Maze_getStart(maze)));
+    solvable = Bitboard_isReachable(bitboard, Maze_getOffset(maze, Maze_getFinish(maze)));
+
+FINALLY:
+    Bitboard_free(&bitboard);
+    return solvable;
+}
+
 bool solveFrom(Maze maze, Room room)
 {
     int i, nadjacent;
@@ -117,58 +376,606 @@ bool solveFrom(Maze maze, Room room)
     return false;
 }
 
-int solveAll(Maze maze, Room room)
+int solveAll(Maze maze, Room room, int found)
 {
     int i, nadjacent;
-    static int solutionCount;
     char marker;
     Room adjacent[4];
 
     marker = Maze_getMarker(room);
-    if (marker == Room_visited) return solutionCount;
+    if (marker == Room_visited || marker == Room_deadend) return found;
     if (room == Maze_getFinish(maze))
     {
-        printf("Solution #%i:\n", ++solutionCount);
+        printf("Solution #%i:\n", ++found);
         Maze_print(maze);
         getchar();
-        return solutionCount;
+        return found;
     }
     Maze_setMarker(room, Room_visited);
     nadjacent = Maze_getAdjacent(maze, room, adjacent, false);
     for (i = 0; i < nadjacent; i++)
-        solveAll(maze, adjacent[i]);
+        found = solveAll(maze, adjacent[i], found);
     Maze_setMarker(room, Room_cleared);
-    return solutionCount;
+    return found;
 }
 
-int solveShort(Maze maze, Room room, int depth, Maze shortMaze)
+int playMaze(Maze maze, int fps)
 {
-    int i, nadjacent;
-    static int shortDepth, solutionCount;
-    char marker;
+    int i, solved;
+    double start;
+    struct player player;
+
+    player.interval = fps > 0 ? 1.0 / fps : 0;
+    player.steps = player.moves = 0;
+    player.written = 0;
+    fitTerminal(maze, &player);
+    showRegion(maze, Maze_getStart(maze), &player);
+    fflush(stdout);
+    start = player.due = getTime();
+    solved = playFrom(maze, Maze_getStart(maze), &player);
+    if (solved > 0)
+        for (i = 0; i < Maze_getRoomCount(maze); i++)
+            if (Maze_getMarkerAt(maze, i) == Room_deadend)
+            {
+                Maze_setMarkerAt(maze, i, Room_cleared);
+                if (isShown(maze, Maze_getRoomAt(maze, i), &player))
+                    redrawRoom(maze, Maze_getRoomAt(maze, i), &player);
+            }
+    printf("\033[%i;1H", 2 * player.nrows + 2);
+    fflush(stdout);
+    fprintf(stderr, "Played %i steps in %.3f s, moving the view %i times and writing %li characters "
+        "after the first frame\n", player.steps, getTime() - start, player.moves, player.written);
+    return solved;
+}
+
+/**
+ * Plays the depth-first search of solveFrom, in the same order, but on a stack
+ * of its own rather than the call stack, so that the depth of the maze is
+ * limited only by memory. A room is marked as a dead end when it is popped.
+ *
+ * \return 1 if the finish was reached, 0 if not, or -1 if the stack could not
+ *     grow.
+ */
+int playFrom(Maze maze, Room room, struct player *player)
+{
+    int solved, nadjacent;
+    size_t depth, size;
+    struct step *stack, *grown;
     Room adjacent[4];
 
-    marker = Maze_getMarker(room);
-    if (marker == Room_visited) return shortDepth;
-    if (room == Maze_getFinish(maze))
+    solved = -1;
+    depth = size = 0;
+    stack = NULL;
+    if (room == Maze_getFinish(maze)) solved = 1;
+    else if (!playRoom(maze, room, player)) solved = 0;
+    if (solved >= 0) goto FINALLY;
+    TRY( (stack = malloc(sizeof *stack * PLAYSTACK)) );
+    size = PLAYSTACK;
+    stack[depth].room = room;
+    stack[depth++].next = 0;
+    while (depth > 0)
     {
-        if (depth < shortDepth || solutionCount == 0)
+        nadjacent = Maze_getAdjacent(maze, stack[depth - 1].room, adjacent, false);
+        if (stack[depth - 1].next >= nadjacent)
+        {
+            Maze_setMarker(stack[--depth].room, Room_deadend);
+            redrawRoom(maze, stack[depth].room, player);
+            continue;
+        }
+        room = adjacent[stack[depth - 1].next++];
+        if (room == Maze_getFinish(maze))
+        {
+            solved = 1;
+            goto FINALLY;
+        }
+        if (!playRoom(maze, room, player)) continue;
+        if (depth == size)
         {
-            Maze_copy(shortMaze, maze);
-            shortDepth = depth;
+            TRY( (grown = realloc(stack, sizeof *stack * size * 2)) );
+            stack = grown;
+            size *= 2;
         }
-        solutionCount++;
-        return shortDepth;
+        stack[depth].room = room;
+        stack[depth++].next = 0;
     }
+    solved = 0;
+
+FINALLY:
+    free(stack);
+    return solved;
+}
+
+/**
+ * Steps into a room, unless it has been visited or is a dead end, marking it
+ * visited and showing it as a frame of its own.
+ *
+ * \return true if the room was stepped into, false if not.
+ */
+bool playRoom(Maze maze, Room room, struct player *player)
+{
+    char marker;
+
+    marker = Maze_getMarker(room);
+    if (marker == Room_visited || marker == Room_deadend) return false;
     Maze_setMarker(room, Room_visited);
-    nadjacent = Maze_getAdjacent(maze, room, adjacent, false);
-    for (i = 0; i < nadjacent; i++)
-        solveShort(maze, adjacent[i], depth + 1, shortMaze);
-    Maze_setMarker(room, Room_cleared);
-    return shortDepth;
+    redrawRoom(maze, room, player);
+    waitFrame(player);
+    return true;
+}
+
+/**
+ * Works out how many rows and columns of rooms fit on the terminal, leaving a
+ * line below the maze for the cursor. If the standard output is not a terminal,
+ * the whole maze is shown.
+ */
+void fitTerminal(Maze maze, struct player *player)
+{
+    struct winsize size;
+
+    player->nrows = Maze_getHeight(maze);
+    player->ncols = Maze_getWidth(maze);
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0 || size.ws_row == 0 || size.ws_col == 0) return;
+    /* two lines to a row of rooms and one for the top border, four columns to a room and one more */
+    if ((size.ws_row - 2) / 2 < player->nrows) player->nrows = (size.ws_row - 2) / 2;
+    if ((size.ws_col - 1) / 4 < player->ncols) player->ncols = (size.ws_col - 1) / 4;
+    if (player->nrows < 1) player->nrows = 1;
+    if (player->ncols < 1) player->ncols = 1;
+}
+
+/**
+ * Tells whether a room is in the block of rooms shown.
+ */
+bool isShown(Maze maze, Room room, struct player *player)
+{
+    int x, y;
+
+    x = Maze_getOffset(maze, room) / Maze_getWidth(maze);
+    y = Maze_getOffset(maze, room) % Maze_getWidth(maze);
+    return x >= player->top && x < player->top + player->nrows
+        && y >= player->left && y < player->left + player->ncols;
 }
 
-bool parseArguments(int argc, char **argv, bool *optshort, bool *optall, char *filename)
+/**
+ * Clears the terminal and shows the block of rooms centred on a room, as near
+ * as the edges of the maze allow.
+ */
+void showRegion(Maze maze, Room room, struct player *player)
+{
+    int x, y;
+
+    x = Maze_getOffset(maze, room) / Maze_getWidth(maze);
+    y = Maze_getOffset(maze, room) % Maze_getWidth(maze);
+    player->top = x - player->nrows / 2;
+    if (player->top > Maze_getHeight(maze) - player->nrows) player->top = Maze_getHeight(maze) - player->nrows;
+    if (player->top < 0) player->top = 0;
+    player->left = y - player->ncols / 2;
+    if (player->left > Maze_getWidth(maze) - player->ncols) player->left = Maze_getWidth(maze) - player->ncols;
+    if (player->left < 0) player->left = 0;
+    fputs("\033[H\033[2J", stdout);
+    Maze_fprintRegion(maze, stdout, player->top, player->left, player->nrows, player->ncols);
+}
+
+/**
+ * Redraws a room whose marker has changed, counting the characters written. If
+ * the room is not shown, the block shown is moved to it first, which draws the
+ * room along with the rest of the block.
+ */
+void redrawRoom(Maze maze, Room room, struct player *player)
+{
+    int written;
+
+    if (!isShown(maze, room, player))
+    {
+        showRegion(maze, room, player);
+        player->moves++;
+        return;
+    }
+    written = Maze_fprintRoomAt(maze, stdout, Maze_getOffset(maze, room), player->top, player->left);
+    if (written > 0) player->written += written;
+}
+
+/**
+ * Shows the frame drawn so far and waits until the next one is due. If playing
+ * has fallen behind, the next frame is due a whole interval from now rather than
+ * straight away, so frames are never shown in a burst to catch up.
+ */
+void waitFrame(struct player *player)
+{
+    double now, delay;
+    struct timespec pause;
+
+    fflush(stdout);
+    player->steps++;
+    if (player->interval <= 0) return;
+    player->due += player->interval;
+    now = getTime();
+    delay = player->due - now;
+    if (delay <= 0)
+    {
+        player->due = now;
+        return;
+    }
+    pause.tv_sec = (time_t)delay;
+    pause.tv_nsec = (long)((delay - pause.tv_sec) * 1e9);
+    nanosleep(&pause, NULL);
+}
+
+bool solveBatch(struct options *options)
+{
+    bool solved, locked;
+    int i, nthreads;
+    double start, elapsed;
+    struct batch batch;
+    pthread_t workers[MAXTHREADS];
+
+    solved = locked = false;
+    nthreads = 0;
+    batch.files = NULL;
+    batch.nfiles = 0;
+    TRY(listFiles(options->files, options->nfiles, &batch.files, &batch.nfiles));
+    batch.next = batch.solved = 0;
+    batch.format = options->format;
+    batch.algorithm = options->algorithm;
+    batch.prune = options->prune;
+    batch.rooms = 0;
+    TRY( (locked = pthread_mutex_init(&batch.lock, NULL) == 0) );
+    start = getTime();
+    for (nthreads = 0; nthreads < options->threads - 1 && nthreads < MAXTHREADS - 1; nthreads++)
+        TRY(pthread_create(&workers[nthreads], NULL, solveThread, &batch) == 0);
+    solveThread(&batch);
+    solved = true;
+
+FINALLY:
+    for (i = 0; i < nthreads; i++) pthread_join(workers[i], NULL);
+    if (solved)
+    {
+        elapsed = getTime() - start;
+        fflush(stdout);
+        fprintf(stderr, "Solved %i mazes of %.0f rooms in %.3f s: %.1f mazes/s, %.0f rooms/s\n",
+            batch.solved, batch.rooms, elapsed, elapsed > 0 ? batch.solved / elapsed : 0,
+            elapsed > 0 ? batch.rooms / elapsed : 0);
+    }
+    if (locked) pthread_mutex_destroy(&batch.lock);
+    for (i = 0; i < batch.nfiles; i++) free(batch.files[i]);
+    free(batch.files);
+    return solved;
+}
+
+bool serveQueries(Maze maze, struct options *options)
+{
+    bool served, locked;
+    int i, nworkers, nthreads, chunk, height, width, sx, sy, fx, fy, nlatencies, size;
+    double start, *latencies, *larger;
+    char line[256];
+    struct server server;
+    struct query *query;
+    struct worker workers[MAXTHREADS];
+    pthread_t threads[MAXTHREADS];
+
+    served = locked = false;
+    nworkers = nthreads = nlatencies = size = 0;
+    latencies = NULL;
+    server.index = NULL;
+    server.queries = NULL;
+    server.algorithm = options->algorithm;
+    height = Maze_getHeight(maze);
+    width = Maze_getWidth(maze);
+    chunk = options->threads > 1 ? QUERYCHUNK : 1;
+    TRY( (server.graph = Graph_new(maze)) );
+    if (options->index && !(server.index = TreeIndex_new(server.graph)))
+        fprintf(stderr, "The maze has loops and cannot be indexed, so every query will be searched.\n");
+    TRY( (server.queries = malloc(sizeof *server.queries * chunk)) );
+    for (i = 0; i < chunk; i++) server.queries[i].path = NULL;
+    for (nworkers = 0; nworkers == 0 || (nworkers < options->threads && nworkers < MAXTHREADS); nworkers++)
+    {
+        workers[nworkers].server = &server;
+        TRY( (workers[nworkers].search = Search_new(server.graph)) );
+    }
+    TRY( (locked = pthread_mutex_init(&server.lock, NULL) == 0) );
+
+    start = getTime();
+    for (;;)
+    {
+        for (server.nqueries = 0; server.nqueries < chunk && fgets(line, sizeof line, stdin); )
+        {
+            if (strspn(line, " \t\r\n") == strlen(line)) continue;
+            query = &server.queries[server.nqueries++];
+            query->from = query->to = -1;
+            if (sscanf(line, "%d %d %d %d", &sx, &sy, &fx, &fy) == 4
+                && sx >= 0 && sx < height && sy >= 0 && sy < width
+                && fx >= 0 && fx < height && fy >= 0 && fy < width)
+            {
+                query->from = sx * width + sy;
+                query->to = fx * width + fy;
+            }
+        }
+        if (server.nqueries == 0) break;
+        server.next = 0;
+        for (nthreads = 0; nthreads < nworkers - 1; nthreads++)
+            TRY(pthread_create(&threads[nthreads], NULL, serveThread, &workers[nthreads + 1]) == 0);
+        serveThread(&workers[0]);
+        for (; nthreads > 0; nthreads--) pthread_join(threads[nthreads - 1], NULL);
+
+        if (nlatencies + server.nqueries > size)
+        {
+            size = 2 * size + server.nqueries;
+            TRY( (larger = realloc(latencies, sizeof *latencies * size)) );
+            latencies = larger;
+        }
+        for (i = 0; i < server.nqueries; i++)
+        {
+            query = &server.queries[i];
+            latencies[nlatencies++] = query->seconds;
+            printPath(query->length, query->path, query->npath, width);
+            free(query->path);
+            query->path = NULL;
+        }
+        fflush(stdout);
+    }
+    printLatencies(latencies, nlatencies, getTime() - start);
+    served = true;
+
+FINALLY:
+    for (; nthreads > 0; nthreads--) pthread_join(threads[nthreads - 1], NULL);
+    if (locked) pthread_mutex_destroy(&server.lock);
+    for (i = 0; i < nworkers; i++) Search_free(&workers[i].search);
+    for (i = 0; server.queries && i < chunk; i++) free(server.queries[i].path);
+    free(server.queries);
+    free(latencies);
+    TreeIndex_free(&server.index);
+    Graph_free(&server.graph);
+    return served;
+}
+
+void *serveThread(void *worker)
+{
+    int i;
+    double start;
+    struct worker *this;
+    struct server *server;
+    struct query *query;
+
+    this = worker;
+    server = this->server;
+    for (;;)
+    {
+        pthread_mutex_lock(&server->lock);
+        i = server->next++;
+        pthread_mutex_unlock(&server->lock);
+        if (i >= server->nqueries) break;
+        query = &server->queries[i];
+        start = getTime();
+        query->length = -1;
+        query->npath = 0;
+        if (query->from < 0) ;
+        else if (server->index)
+            query->length = TreeIndex_getDistance(server->index, query->from, query->to);
+        else
+            query->length = Search_findPath(this->search, server->algorithm, query->from, query->to, NULL);
+        if (query->length >= 0 && (query->path = malloc(sizeof *query->path * (query->length + 1))))
+        {
+            if (server->index)
+                query->npath = TreeIndex_getPath(server->index, query->from, query->to, query->path);
+            else
+                query->npath = Search_getPath(this->search, query->path);
+        }
+        query->seconds = getTime() - start;
+    }
+    return NULL;
+}
+
+bool editMaze(Maze maze)
+{
+    bool edited, applied;
+    int x1, y1, x2, y2, height, width, from, to, start, changed, npath, nedits, nrepaired;
+    int *path;
+    double began, elapsed;
+    char line[256], command[16];
+    DistanceField field;
+
+    edited = false;
+    path = NULL;
+    field = NULL;
+    nedits = nrepaired = npath = 0;
+    elapsed = 0;
+    height = Maze_getHeight(maze);
+    width = Maze_getWidth(maze);
+    start = Maze_getOffset(maze, Maze_getStart(maze));
+    TRY( (path = malloc(sizeof *path * Maze_getRoomCount(maze))) );
+    TRY( (field = DistanceField_new(maze)) );
+    npath = DistanceField_getPath(field, start, path);
+    printPath(npath - 1, path, npath, width);
+    while (fgets(line, sizeof line, stdin))
+    {
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+        applied = false;
+        if (sscanf(line, "%15s %d %d %d %d", command, &x1, &y1, &x2, &y2) == 5
+            && x1 >= 0 && x1 < height && y1 >= 0 && y1 < width
+            && x2 >= 0 && x2 < height && y2 >= 0 && y2 < width)
+        {
+            from = x1 * width + y1;
+            to = x2 * width + y2;
+            began = getTime();
+            if (strcmp(command, "tunnel") == 0) applied = Maze_tunnelAt(maze, from, to);
+            else if (strcmp(command, "wall") == 0) applied = Maze_addWallAt(maze, from, to);
+            if (applied)
+            {
+                TRY( (changed = DistanceField_update(field, from, to)) >= 0 );
+                npath = DistanceField_getPath(field, start, path);
+                nedits++;
+                nrepaired += changed;
+            }
+            elapsed += getTime() - began;
+        }
+        if (applied) printPath(npath - 1, path, npath, width);
+        else puts("-1");
+        fflush(stdout);
+    }
+    fprintf(stderr, "Applied %i edits in %.3f s: %.1f us and %.1f rooms repaired per edit\n", nedits, elapsed,
+        nedits ? 1e6 * elapsed / nedits : 0, nedits ? (double)nrepaired / nedits : 0);
+    edited = true;
+
+FINALLY:
+    DistanceField_free(&field);
+    free(path);
+    return edited;
+}
+
+/**
+ * Prints the length of a path and the rooms along it as row,column pairs on one
+ * line.
+ */
+void printPath(int length, int *path, int npath, int width)
+{
+    int i;
+
+    printf("%i", length);
+    for (i = 0; i < npath; i++) printf(" %i,%i", path[i] / width, path[i] % width);
+    putchar('\n');
+}
+
+/**
+ * Prints the number of queries answered per second, and the median, 90th and
+ * 99th percentile and longest times taken to answer them, in microseconds.
+ */
+void printLatencies(double *latencies, int nlatencies, double elapsed)
+{
+    fprintf(stderr, "Answered %i queries in %.3f s: %.1f queries/s\n", nlatencies, elapsed,
+        elapsed > 0 ? nlatencies / elapsed : 0);
+    if (nlatencies == 0) return;
+    qsort(latencies, nlatencies, sizeof *latencies, compareDoubles);
+    fprintf(stderr, "Latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+        1e6 * latencies[(int)(0.50 * (nlatencies - 1))], 1e6 * latencies[(int)(0.90 * (nlatencies - 1))],
+        1e6 * latencies[(int)(0.99 * (nlatencies - 1))], 1e6 * latencies[nlatencies - 1]);
+}
+
+int compareDoubles(const void *first, const void *second)
+{
+    double a, b;
+
+    a = *(const double *)first;
+    b = *(const double *)second;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Lists the files named, putting the files inside any directory named in place
+ * of the directory itself. Hidden files and directories inside directories are
+ * skipped.
+ */
+bool listFiles(char **names, int nnames, char ***files, int *nfiles)
+{
+    bool listed;
+    int i, size;
+    char *path;
+    DIR *directory;
+    struct dirent *entry;
+    struct stat status;
+
+    listed = false;
+    directory = NULL;
+    path = NULL;
+    size = 0;
+    for (i = 0; i < nnames; i++)
+    {
+        if (stat(names[i], &status) != 0 || !S_ISDIR(status.st_mode))
+        {
+            TRY(addFile(names[i], files, nfiles, &size));
+            continue;
+        }
+        TRY( (directory = opendir(names[i])) );
+        while ( (entry = readdir(directory)) )
+        {
+            if (entry->d_name[0] == '.') continue;
+            TRY( (path = malloc(strlen(names[i]) + strlen(entry->d_name) + 2)) );
+            sprintf(path, "%s/%s", names[i], entry->d_name);
+            if (stat(path, &status) == 0 && !S_ISDIR(status.st_mode))
+                TRY(addFile(path, files, nfiles, &size));
+            free(path);
+            path = NULL;
+        }
+        closedir(directory);
+        directory = NULL;
+    }
+    listed = true;
+
+FINALLY:
+    if (directory) closedir(directory);
+    free(path);
+    return listed;
+}
+
+bool addFile(char *name, char ***files, int *nfiles, int *size)
+{
+    bool added;
+    char **larger;
+
+    added = false;
+    if (*nfiles == *size)
+    {
+        TRY( (larger = realloc(*files, sizeof *larger * (*size ? 2 * *size : 64))) );
+        *files = larger;
+        *size = *size ? 2 * *size : 64;
+    }
+    TRY( ((*files)[*nfiles] = malloc(strlen(name) + 1)) );
+    strcpy((*files)[(*nfiles)++], name);
+    added = true;
+
+FINALLY:
+    return added;
+}
+
+/**
+ * Takes files from a batch until there are none left. A line is printed for
+ * every file: its name, the length of its shortest solution (-1 if there is
+ * none), the number of rooms the search visited, and the seconds the search
+ * took. Files that cannot be read are reported on the standard error stream.
+ */
+void *solveThread(void *batch)
+{
+    int i, length, visited;
+    double start, elapsed;
+    Maze maze;
+    struct batch *this;
+
+    this = batch;
+    for (;;)
+    {
+        pthread_mutex_lock(&this->lock);
+        i = this->next++;
+        pthread_mutex_unlock(&this->lock);
+        if (i >= this->nfiles) break;
+        if (!(maze = Maze_new()) || !Maze_importAs(maze, this->files[i], this->format))
+        {
+            fprintf(stderr, "%s: cannot be read\n", this->files[i]);
+            Maze_free(&maze);
+            continue;
+        }
+        visited = 0;
+        start = getTime();
+        if (this->prune && Solver_prune(maze) < 0) length = -1;
+        else length = Solver_findPath(maze, this->algorithm, &visited);
+        elapsed = getTime() - start;
+
+        pthread_mutex_lock(&this->lock);
+        printf("%s %i %i %.6f\n", this->files[i], length, visited, elapsed);
+        this->solved++;
+        this->rooms += Maze_getRoomCount(maze);
+        pthread_mutex_unlock(&this->lock);
+        Maze_free(&maze);
+    }
+    return NULL;
+}
+
+double getTime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+bool parseArguments(int argc, char **argv, struct options *options)
 {
     int i;
 
@@ -176,17 +983,65 @@ bool parseArguments(int argc, char **argv, bool *optshort, bool *optall, char *f
     {
         if (strcmp("-help", argv[i]) == 0) {printHelp(); return false;}
         if (strcmp("-h", argv[i]) == 0) {printHelp(); return false;}
-        if (strcmp("-short", argv[i]) == 0) *optshort = true;
-        if (strcmp("-all", argv[i]) == 0) *optall = true;
-        else strcpy(filename, argv[i]);
+        if (strcmp("-short", argv[i]) == 0) options->shortest = true;
+        else if (strcmp("-all", argv[i]) == 0) options->all = true;
+        else if (strcmp("-count", argv[i]) == 0) options->count = true;
+        else if (strcmp("-batch", argv[i]) == 0) options->batch = true;
+        else if (strcmp("-prune", argv[i]) == 0) options->prune = true;
+        else if (strcmp("-serve", argv[i]) == 0) options->serve = true;
+        else if (strcmp("-index", argv[i]) == 0) options->index = true;
+        else if (strcmp("-edit", argv[i]) == 0) options->edit = true;
+        else if (strcmp("-play", argv[i]) == 0) options->play = true;
+        else if (strcmp("-fps", argv[i]) == 0 && argv[++i])
+            options->fps = strtol(argv[i], NULL, 0);
+        else if (strcmp("-algo", argv[i]) == 0 && argv[++i])
+        {
+            if (strcmp("bfs", argv[i]) == 0) options->algorithm = Solver_bfs;
+            else if (strcmp("astar", argv[i]) == 0) options->algorithm = Solver_astar;
+            else if (strcmp("bibfs", argv[i]) == 0) options->algorithm = Solver_bibfs;
+            else {printHelp(); return false;}
+        }
+        else if (strcmp("-threads", argv[i]) == 0 && argv[++i])
+            options->threads = strtol(argv[i], NULL, 0);
+        else if (strcmp("-text", argv[i]) == 0) options->format = Maze_formatText;
+        else if (strcmp("-binary", argv[i]) == 0) options->format = Maze_formatBinary;
+        else
+        {
+            options->files[options->nfiles++] = argv[i];
+            strncpy(options->filename, argv[i], sizeof options->filename - 1);
+            options->filename[sizeof options->filename - 1] = '\0';
+        }
     }
     return true;
 }
 
 void printHelp(void)
 {
-    fprintf(stderr, "USAGE: maze-solve [-short] [-all] <filename>\n");
-    fprintf(stderr, "    where -short shows the shortest solution,\n");
-    fprintf(stderr, "          -all shows all solutions\n");
+    fprintf(stderr, "USAGE: maze-solve [-prune] [-short] [-all] [-count] [-algo A] [-threads N] [-text|-binary] <filename>\n");
+    fprintf(stderr, "       maze-solve -play [-fps N] [-prune] [-text|-binary] <filename>\n");
+    fprintf(stderr, "       maze-solve -batch [-prune] [-algo A] [-threads N] [-text|-binary] <file or directory>...\n");
+    fprintf(stderr, "       maze-solve -serve [-index] [-algo A] [-threads N] [-text|-binary] <filename>\n");
+    fprintf(stderr, "       maze-solve -edit [-text|-binary] <filename>\n");
+    fprintf(stderr, "    where -prune marks every room off all solutions as a dead end\n");
+    fprintf(stderr, "          before solving, or shows the pruned maze on its own,\n");
+    fprintf(stderr, "          -short shows the shortest solution,\n");
+    fprintf(stderr, "          -all shows all solutions,\n");
+    fprintf(stderr, "          -count counts all solutions without showing them,\n");
+    fprintf(stderr, "          -batch solves every file given, one line each,\n");
+    fprintf(stderr, "          -serve answers \"sx sy fx fy\" queries from the standard\n");
+    fprintf(stderr, "          input with the length of the path and the path,\n");
+    fprintf(stderr, "          -index answers queries about a maze without loops from\n");
+    fprintf(stderr, "          an index rather than by searching,\n");
+    fprintf(stderr, "          -play plays the step-by-step solution back, redrawing\n");
+    fprintf(stderr, "          only the rooms that change, at N steps a second (%i\n", DEFAULTFPS);
+    fprintf(stderr, "          by default, 0 for no limit) given with -fps, showing as\n");
+    fprintf(stderr, "          much of the maze as fits on the terminal,\n");
+    fprintf(stderr, "          -edit applies \"tunnel|wall x1 y1 x2 y2\" edits from the\n");
+    fprintf(stderr, "          standard input, printing the new solution after each,\n");
+    fprintf(stderr, "          -algo finds the shortest solution with A: bfs (the\n");
+    fprintf(stderr, "          default), astar or bibfs,\n");
+    fprintf(stderr, "          -threads counts or solves a batch on N threads,\n");
+    fprintf(stderr, "          -text or -binary reads the file in that format\n");
+    fprintf(stderr, "          instead of detecting it\n");
     fprintf(stderr, "    no flags solves the maze in filename step-by-step\n");
 }
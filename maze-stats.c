@@ -0,0 +1,319 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define DEBUG
+
+#include "bool.h"
+#include "try.h"
+#include "maze.h"
+#include "bitboard.h"
+
+#define NORTH 1
+#define EAST  2
+#define SOUTH 4
+#define WEST  8
+#define MAXTHREADS 256
+
+/**
+ * The options maze-stats was run with.
+ */
+struct options
+{
+    int format, threads;
+    char filename[256];
+};
+
+/**
+ * The rows of a maze from first up to last, counted by a thread of its own: the
+ * number of rooms with each number of passages out of them, the passages joining
+ * each room to the rooms west and north of it, and the number of those that
+ * joined two parts of the band not already joined, found by union-find. The
+ * parent of every room is kept in one array for the whole maze, and each band
+ * only ever touches its own rooms of it, so the bands need no locking; the
+ * passages north out of the first row of a band are left to be joined once all
+ * the bands are done.
+ */
+struct band
+{
+    Maze maze;
+    int *parent;
+    int first, last;
+    long degrees[5], passages, joins;
+};
+
+/**
+ * What maze-stats finds out about a maze.
+ */
+struct stats
+{
+    long degrees[5], passages, components, loops;
+    int solution, diameter, ends[2];
+};
+
+/**
+ * Finds the statistics of a maze: the number of rooms with each number of
+ * passages out of them, the dead ends being those with one; the number of
+ * passages, and of the parts of the maze not joined to each other, with which
+ * the number of loops is the number of passages more than a maze without loops
+ * joining as many rooms in as many parts would have; the length of the
+ * solution; and the longest of the shortest paths from the rooms that can be
+ * reached from the start, found with two breadth-first searches, the second
+ * from the room the first found furthest from the start. Without loops that is
+ * the longest path the start can reach; with them it may fall short, and the
+ * parts of the maze the start cannot reach are not searched at all. Passages are taken to
+ * be the same from both sides, as the generator leaves them.
+ *
+ * \param maze The maze to examine.
+ * \param threads The number of threads to count passages and parts with.
+ * \param stats Filled with the statistics.
+ *
+ * \return true if the statistics were found, false if there was not enough
+ *     memory.
+ */
+bool findStats(Maze maze, int threads, struct stats *stats);
+void *countBand(void *band);
+int findRoot(int *parent, int room);
+bool joinRooms(int *parent, int first, int second);
+void printStats(Maze maze, struct stats *stats);
+double getTime(void);
+
+/* argument parsing */
+bool parseArguments(int argc, char **argv, struct options *options);
+void printHelp(void);
+
+int main(int argc, char **argv)
+{
+    bool status;
+    double start;
+    struct options options;
+    struct stats stats;
+    Maze myMaze;
+
+    status = EXIT_FAILURE;
+    options.format = Maze_formatAuto;
+    options.threads = 1;
+    strcpy(options.filename, "-");
+    myMaze = Maze_new();
+
+    TRY( (parseArguments(argc, argv, &options)) );
+    TRY(myMaze);
+    TRY(argc > 1);
+    TRY(Maze_importAs(myMaze, options.filename, options.format));
+    start = getTime();
+    TRY(findStats(myMaze, options.threads, &stats));
+    printStats(myMaze, &stats);
+    fflush(stdout);
+    fprintf(stderr, "Examined %i rooms in %.3f s\n", Maze_getRoomCount(myMaze), getTime() - start);
+    status = EXIT_SUCCESS;
+
+FINALLY:
+    Maze_free(&myMaze);
+    return status;
+}
+
+bool findStats(Maze maze, int threads, struct stats *stats)
+{
+    bool found;
+    int i, j, nbands, nthreads, height, width, room, start, far;
+    struct band bands[MAXTHREADS];
+    pthread_t workers[MAXTHREADS];
+    Bitboard bitboard;
+
+    found = false;
+    nthreads = 0;
+    bitboard = NULL;
+    height = Maze_getHeight(maze);
+    width = Maze_getWidth(maze);
+    nbands = threads < 1 ? 1 : threads > MAXTHREADS ? MAXTHREADS : threads;
+    if (nbands > height) nbands = height;
+    TRY( (bands[0].parent = malloc(sizeof *bands[0].parent * Maze_getRoomCount(maze))) );
+    for (i = 0; i < nbands; i++)
+    {
+        bands[i].maze = maze;
+        bands[i].parent = bands[0].parent;
+        bands[i].first = (int)((double)height * i / nbands);
+        bands[i].last = (int)((double)height * (i + 1) / nbands);
+    }
+    for (nthreads = 0; nthreads < nbands - 1; nthreads++)
+        TRY(pthread_create(&workers[nthreads], NULL, countBand, &bands[nthreads + 1]) == 0);
+    countBand(&bands[0]);
+    for (; nthreads > 0; nthreads--) pthread_join(workers[nthreads - 1], NULL);
+
+    memset(stats, 0, sizeof *stats);
+    stats->components = Maze_getRoomCount(maze);
+    for (i = 0; i < nbands; i++)
+    {
+        for (j = 0; j < 5; j++) stats->degrees[j] += bands[i].degrees[j];
+        stats->passages += bands[i].passages;
+        stats->components -= bands[i].joins;
+        if (i == 0) continue;
+        /* join the bands across the passages north out of their first rows */
+        for (room = bands[i].first * width; room < (bands[i].first + 1) * width; room++)
+            if (!(Maze_getWallsAt(maze, room) & NORTH))
+            {
+                stats->passages++;
+                if (joinRooms(bands[0].parent, room, room - width)) stats->components--;
+            }
+    }
+    stats->loops = stats->passages - Maze_getRoomCount(maze) + stats->components;
+
+    TRY( (bitboard = Bitboard_new(maze)) );
+    start = Maze_getOffset(maze, Maze_getStart(maze));
+    Bitboard_findFarthest(bitboard, start, Maze_getOffset(maze, Maze_getFinish(maze)), &far,
+        &stats->solution);
+    stats->diameter = Bitboard_findFarthest(bitboard, far, -1, &stats->ends[1], NULL);
+    stats->ends[0] = far;
+    found = true;
+
+FINALLY:
+    for (; nthreads > 0; nthreads--) pthread_join(workers[nthreads - 1], NULL);
+    Bitboard_free(&bitboard);
+    free(bands[0].parent);
+    return found;
+}
+
+/**
+ * Counts the passages and joins the parts of one band of a maze, on a thread of
+ * its own.
+ */
+void *countBand(void *band)
+{
+    int x, y, room, height, width, walls, open, degree;
+    struct band *this;
+
+    this = band;
+    height = Maze_getHeight(this->maze);
+    width = Maze_getWidth(this->maze);
+    memset(this->degrees, 0, sizeof this->degrees);
+    this->passages = this->joins = 0;
+    for (x = this->first; x < this->last; x++)
+        for (y = 0, room = x * width; y < width; y++, room++)
+        {
+            this->parent[room] = room;
+            walls = Maze_getWallsAt(this->maze, room);
+            open = ~walls & (NORTH + EAST + SOUTH + WEST);
+            if (x == 0) open &= ~NORTH;
+            if (y == width - 1) open &= ~EAST;
+            if (x == height - 1) open &= ~SOUTH;
+            if (y == 0) open &= ~WEST;
+            degree = (open & NORTH ? 1 : 0) + (open & EAST ? 1 : 0) + (open & SOUTH ? 1 : 0)
+                + (open & WEST ? 1 : 0);
+            this->degrees[degree]++;
+            if (open & WEST)
+            {
+                this->passages++;
+                if (joinRooms(this->parent, room, room - 1)) this->joins++;
+            }
+            if ((open & NORTH) && x > this->first)
+            {
+                this->passages++;
+                if (joinRooms(this->parent, room, room - width)) this->joins++;
+            }
+        }
+    return NULL;
+}
+
+/**
+ * Finds the room heading the part of the maze a room belongs to, halving the
+ * path to it on the way so that the next search is shorter.
+ */
+int findRoot(int *parent, int room)
+{
+    while (parent[room] != room)
+    {
+        parent[room] = parent[parent[room]];
+        room = parent[room];
+    }
+    return room;
+}
+
+/**
+ * Joins the parts of the maze two rooms belong to, the part whose head comes
+ * later taking the other's head as its own.
+ *
+ * \return true if the rooms were in different parts, false if not.
+ */
+bool joinRooms(int *parent, int first, int second)
+{
+    first = findRoot(parent, first);
+    second = findRoot(parent, second);
+    if (first == second) return false;
+    if (first < second) parent[second] = first;
+    else parent[first] = second;
+    return true;
+}
+
+/**
+ * Prints the statistics of a maze as a JSON object. The diameter is only exact
+ * when the maze has no loops and every room can be reached from the start.
+ */
+void printStats(Maze maze, struct stats *stats)
+{
+    int width;
+
+    width = Maze_getWidth(maze);
+    printf("{\n");
+    printf("  \"height\": %i,\n  \"width\": %i,\n  \"rooms\": %i,\n", Maze_getHeight(maze), width,
+        Maze_getRoomCount(maze));
+    printf("  \"passages\": %li,\n  \"components\": %li,\n  \"loops\": %li,\n", stats->passages,
+        stats->components, stats->loops);
+    printf("  \"dead_ends\": %li,\n", stats->degrees[1]);
+    printf("  \"degrees\": [%li, %li, %li, %li, %li],\n", stats->degrees[0], stats->degrees[1],
+        stats->degrees[2], stats->degrees[3], stats->degrees[4]);
+    printf("  \"solution_length\": %i,\n", stats->solution);
+    printf("  \"diameter\": %i,\n  \"diameter_exact\": %s,\n", stats->diameter,
+        stats->loops == 0 && stats->components == 1 ? "true" : "false");
+    printf("  \"diameter_ends\": [[%i, %i], [%i, %i]]\n", stats->ends[0] / width,
+        stats->ends[0] % width, stats->ends[1] / width, stats->ends[1] % width);
+    printf("}\n");
+}
+
+double getTime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+bool parseArguments(int argc, char **argv, struct options *options)
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp("-help", argv[i]) == 0) {printHelp(); return false;}
+        if (strcmp("-h", argv[i]) == 0) {printHelp(); return false;}
+        if (strcmp("-threads", argv[i]) == 0 && argv[++i])
+            options->threads = strtol(argv[i], NULL, 0);
+        else if (strcmp("-text", argv[i]) == 0) options->format = Maze_formatText;
+        else if (strcmp("-binary", argv[i]) == 0) options->format = Maze_formatBinary;
+        else
+        {
+            strncpy(options->filename, argv[i], sizeof options->filename - 1);
+            options->filename[sizeof options->filename - 1] = '\0';
+        }
+    }
+    return true;
+}
+
+void printHelp(void)
+{
+    fprintf(stderr, "USAGE: maze-stats [-threads N] [-text|-binary] <filename>\n");
+    fprintf(stderr, "    where -threads counts the passages and parts of the maze on N\n");
+    fprintf(stderr, "          threads, each taking a band of its rows,\n");
+    fprintf(stderr, "          -text or -binary reads the file in that format\n");
+    fprintf(stderr, "          instead of detecting it\n");
+    fprintf(stderr, "    prints the dead ends, loops, longest path and other\n");
+    fprintf(stderr, "    statistics of the maze as a JSON object\n");
+}
+
+#undef NORTH
+#undef EAST
+#undef SOUTH
+#undef WEST
@@ -1,7 +1,11 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "maze.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "try.h"
 
@@ -11,21 +15,90 @@
 #define WEST  8
 int opposite(int dir) { return dir > 2 ? dir >> 2 : dir << 2; }
 
+#define BINARYMAGIC "MAZB"
+#define COMPRESSEDMAGIC "MAZC"
+#define BINARYPACKED 1
+#define SCANBLOCK 65536
+#define LINEBYTES(ny) (7 * (size_t)(ny) + 8)
+
+/**
+ * Header of the binary maze format. It is followed directly by one byte of wall
+ * bits per room (or one nibble, if the BINARYPACKED flag is set), in the same
+ * order as the MDF, so that the rest of the file can be used as the walls of a
+ * maze as is. Values are stored in host byte order. The compressed format has
+ * the same header with its own magic, followed by its encoded rows.
+ */
+struct header
+{
+    char magic[4];
+    int nx, ny;
+    int sx, sy;
+    int fx, fy;
+    int flags;
+};
+
+/**
+ * The walls of the rooms are kept apart from the rooms themselves so that they
+ * can be read from (or mapped straight out of) a binary maze file. A room only
+ * holds its marker, and the walls of a room are found at the room's offset into
+ * the walls, which hold either a byte per room or, in a packed maze, a nibble
+ * per room (low nibble first).
+ *
+ * The markers are allocated zeroed and a cleared room is stored as 0, so the
+ * pages of the grid are not touched, and on most systems not even committed,
+ * until something actually marks a room.
+ */
 struct room
 {
-    int walls;
     char marker;
 };
 
 struct maze
 {
-    int nx, ny;
+    int nx, ny, format;
+    bool packed;
     Room start, finish, grid;
+    unsigned char *walls;
+    void *map;
+    size_t mapsize;
+};
+
+/**
+ * Reads the numbers of a text maze out of a file a block at a time and parses
+ * them by hand, rather than with one fscanf per room, which otherwise takes most
+ * of the time spent reading a large text maze. The file is read ahead a block at
+ * a time, so nothing else should read from it while the scanner is in use.
+ */
+struct scanner
+{
+    FILE *fp;
+    char *block;
+    size_t next, end;
 };
 
 int getX(Maze this, Room room) { return (room - this->grid) / (this->ny); }
 int getY(Maze this, Room room) { return (room - this->grid) % this->ny; }
-bool hasWall(Room room, int wall) { return (room->walls & wall) != 0; }
+size_t wallBytes(Maze this)
+{
+    size_t nrooms;
+
+    nrooms = (size_t)this->nx * this->ny;
+    return this->packed ? (nrooms + 1) / 2 : nrooms;
+}
+int getWallsAt(Maze this, size_t offset)
+{
+    if (this->packed) return (this->walls[offset >> 1] >> ((offset & 1) << 2)) & 15;
+    return this->walls[offset];
+}
+void setWallsAt(Maze this, size_t offset, int walls)
+{
+    if (this->packed)
+        this->walls[offset >> 1] = (this->walls[offset >> 1] & (0xF0 >> ((offset & 1) << 2)))
+            | (walls << ((offset & 1) << 2));
+    else this->walls[offset] = walls;
+}
+int getWalls(Maze this, Room room) { return getWallsAt(this, room - this->grid); }
+bool hasWall(Maze this, Room room, int wall) { return (getWalls(this, room) & wall) != 0; }
 bool inMaze(Maze this, int x, int y) { return x >= 0 && y >= 0 && x < this->nx && y < this->ny; }
 Room getRoom(Maze this, int x, int y) { return inMaze(this, x, y) ? &this->grid[x * this->ny + y] : NULL; }
 
@@ -37,85 +110,780 @@ Maze Maze_new(void)
     TRY(this);
 
     this->nx = this->ny = 0;
+    this->format = Maze_formatText;
+    this->packed = false;
     this->start = this->finish = this->grid = NULL;
+    this->walls = NULL;
+    this->map = NULL;
+    this->mapsize = 0;
 
 FINALLY:
     return this;
 }
 
+bool allocateGrid(Maze this);
+int detectFormat(FILE *fp);
+bool readHeader(FILE *fp, int *format, struct header *header);
+bool openScanner(struct scanner *scanner, FILE *fp);
+bool fillScanner(struct scanner *scanner, char **next, char **end);
+bool scanWalls(struct scanner *scanner, unsigned char *walls, size_t count);
+void closeScanner(struct scanner *scanner);
+bool importText(Maze this, FILE *fp);
+bool importBinary(Maze this, FILE *fp, struct header *header);
+bool importCompressed(Maze this, FILE *fp);
+int scanByte(struct scanner *scanner);
+bool scanCount(struct scanner *scanner, unsigned long *count);
+bool decodeRow(struct scanner *scanner, unsigned char *above, unsigned char *walls, int ny);
+int predictWalls(unsigned char *above, unsigned char *walls, int y);
 bool Maze_import(Maze this, char *filename)
+{
+    return Maze_importAs(this, filename, Maze_formatAuto);
+}
+
+bool Maze_importAs(Maze this, char *filename, int format)
 {
     bool imported;
-    int x, y;
-    Room room;
     FILE *fp;
+    struct header header;
 
     imported = false;
     fp = NULL;
     TRY(this);
     if (strcmp(filename, "-") == 0) fp = stdin;
-    else TRY( (fp = fopen(filename, "r")) );
-    TRY(fscanf(fp, "%i %i ", &this->nx, &this->ny) == 2);
-    TRY( (this->grid = malloc(sizeof *this->grid * this->nx * this->ny)) );
-    TRY(fscanf(fp, "%d %d", &x, &y) == 2);
-    TRY( (this->start = getRoom(this, x, y)) );
-    TRY(fscanf(fp, "%d %d", &x, &y) == 2);
-    TRY( (this->finish = getRoom(this, x, y)) );
-    for (x = 0; x < this->nx; x++)
-        for (y = 0; y < this->ny; y++)
+    else TRY( (fp = fopen(filename, "rb")) );
+    if (format == Maze_formatAuto) TRY( (format = detectFormat(fp)) );
+    TRY(readHeader(fp, &format, &header));
+    this->nx = header.nx; this->ny = header.ny;
+    if (format == Maze_formatBinary) TRY(importBinary(this, fp, &header));
+    else if (format == Maze_formatCompressed) TRY(importCompressed(this, fp));
+    else TRY(importText(this, fp));
+    TRY( (this->start = getRoom(this, header.sx, header.sy)) );
+    TRY( (this->finish = getRoom(this, header.fx, header.fy)) );
+    this->format = format;
+    imported = true;
+
+FINALLY:
+    if (fp && fp != stdin) fclose(fp);
+    return imported;
+}
+
+/**
+ * Peeks at the first character of a file to tell which format it is in. Both
+ * binary formats start alike, so readHeader tells them apart by their magic.
+ *
+ * \return The format of the file, or Maze_formatAuto if the file is empty.
+ */
+int detectFormat(FILE *fp)
+{
+    int c;
+
+    if ((c = getc(fp)) == EOF || ungetc(c, fp) == EOF) return Maze_formatAuto;
+    return c == BINARYMAGIC[0] ? Maze_formatBinary : Maze_formatText;
+}
+
+/**
+ * Reads the header of a maze file of any format into a binary header, and
+ * leaves the file at the first room. A file expected to be binary may turn out
+ * to be compressed instead, in which case the format is changed to match.
+ */
+bool readHeader(FILE *fp, int *format, struct header *header)
+{
+    bool read;
+
+    read = false;
+    memset(header, 0, sizeof *header);
+    if (*format != Maze_formatText)
+    {
+        TRY(fread(header, sizeof *header, 1, fp) == 1);
+        if (memcmp(header->magic, COMPRESSEDMAGIC, sizeof header->magic) == 0)
+            *format = Maze_formatCompressed;
+        else
+            TRY(*format == Maze_formatBinary && memcmp(header->magic, BINARYMAGIC, sizeof header->magic) == 0);
+    }
+    else
+    {
+        TRY(fscanf(fp, "%i %i ", &header->nx, &header->ny) == 2);
+        TRY(fscanf(fp, "%d %d", &header->sx, &header->sy) == 2);
+        TRY(fscanf(fp, "%d %d", &header->fx, &header->fy) == 2);
+    }
+    TRY(header->nx > 0 && header->ny > 0);
+    read = true;
+
+FINALLY:
+    return read;
+}
+
+bool importText(Maze this, FILE *fp)
+{
+    bool imported;
+    size_t nrooms;
+    struct scanner scanner;
+
+    imported = false;
+    scanner.block = NULL;
+    nrooms = (size_t)this->nx * this->ny;
+    this->packed = false;
+    TRY( (this->walls = malloc(sizeof *this->walls * nrooms)) );
+    TRY(allocateGrid(this));
+    TRY(openScanner(&scanner, fp));
+    TRY(scanWalls(&scanner, this->walls, nrooms));
+    imported = true;
+
+FINALLY:
+    closeScanner(&scanner);
+    return imported;
+}
+
+bool openScanner(struct scanner *scanner, FILE *fp)
+{
+    scanner->fp = fp;
+    scanner->next = scanner->end = 0;
+    if (!(scanner->block = malloc(SCANBLOCK + 1))) return false;
+    scanner->block[0] = '\0';
+    return true;
+}
+
+/**
+ * Reads the next block of the file once the last has been used up. The block is
+ * always followed by a null character, which is neither whitespace nor a digit,
+ * so the loops of scanWalls stop at the end of the block without checking for it.
+ *
+ * \return false at the end of the file.
+ */
+bool fillScanner(struct scanner *scanner, char **next, char **end)
+{
+    scanner->next = 0;
+    scanner->end = fread(scanner->block, 1, SCANBLOCK, scanner->fp);
+    scanner->block[scanner->end] = '\0';
+    *next = scanner->block;
+    *end = scanner->block + scanner->end;
+    return scanner->end > 0;
+}
+
+/**
+ * Reads the next whitespace-separated numbers into an array of walls, as one
+ * fscanf %d per number would. Every number must be a set of walls from 0 to 15,
+ * since a wall byte could not give any other number back when written out.
+ *
+ * \return true if every number was read, false if the file ended, something
+ *     other than a number was found first, or a number was out of range.
+ */
+bool scanWalls(struct scanner *scanner, unsigned char *walls, size_t count)
+{
+    bool scanned, negative;
+    int c, digits;
+    long number;
+    size_t i;
+    char *p, *end;
+
+    scanned = false;
+    p = scanner->block + scanner->next;
+    end = scanner->block + scanner->end;
+    for (i = 0; i < count; i++)
+    {
+        for (;;)
         {
-            room = getRoom(this, x, y);
-            TRY(fscanf(fp, "%d", &room->walls) == 1);
-            Maze_setMarker(room, Room_cleared);
+            while ((c = *p) == ' ' || c == '\n' || (c >= '\t' && c <= '\r')) p++;
+            if (p != end) break;
+            TRY(fillScanner(scanner, &p, &end));
+        }
+        /* walls are almost always one or two digits and a space or newline */
+        if ((c -= '0') >= 0 && c <= 9)
+        {
+            if (p[1] == ' ' || p[1] == '\n')
+            {
+                walls[i] = c;
+                p += 2;
+                continue;
+            }
+            if (p[1] >= '0' && p[1] <= '9' && (p[2] == ' ' || p[2] == '\n'))
+            {
+                TRY(10 * c + (p[1] - '0') <= NORTH + EAST + SOUTH + WEST);
+                walls[i] = 10 * c + (p[1] - '0');
+                p += 3;
+                continue;
+            }
         }
+        if ((negative = *p == '-') || *p == '+')
+            if (++p == end) TRY(fillScanner(scanner, &p, &end));
+        number = digits = 0;
+        for (;;)
+        {
+            for (; (c = *p - '0') >= 0 && c <= 9; p++, digits++)
+                if (number <= NORTH + EAST + SOUTH + WEST) number = 10 * number + c;
+            if (p != end || !fillScanner(scanner, &p, &end)) break;
+        }
+        TRY(digits > 0);
+        TRY(number <= NORTH + EAST + SOUTH + WEST && !(negative && number));
+        walls[i] = number;
+    }
+    scanned = true;
+
+FINALLY:
+    scanner->next = p - scanner->block;
+    return scanned;
+}
+
+void closeScanner(struct scanner *scanner)
+{
+    free(scanner->block);
+    scanner->block = NULL;
+}
+
+/**
+ * Reads a binary maze. Regular files are mapped privately into memory and their
+ * wall bytes are used as the walls of the maze without being copied, so that
+ * tunneling only ever touches the pages it changes. Anything that cannot be
+ * mapped, such as the standard input, is read into memory instead.
+ */
+bool importBinary(Maze this, FILE *fp, struct header *header)
+{
+    bool imported;
+    size_t nbytes;
+    struct stat info;
+
+    imported = false;
+    this->packed = (header->flags & BINARYPACKED) != 0;
+    nbytes = wallBytes(this);
+    if (fp != stdin && fstat(fileno(fp), &info) == 0 && S_ISREG(info.st_mode))
+    {
+        TRY((size_t)info.st_size >= sizeof *header + nbytes);
+        this->map = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+        if (this->map == MAP_FAILED) this->map = NULL;
+        else this->mapsize = info.st_size;
+    }
+    if (this->map) this->walls = (unsigned char *)this->map + sizeof *header;
+    else
+    {
+        TRY( (this->walls = malloc(nbytes)) );
+        TRY(fread(this->walls, 1, nbytes, fp) == nbytes);
+    }
+    TRY(allocateGrid(this));
     imported = true;
 
 FINALLY:
-    if (fp && fp != stdin) fclose(fp);
     return imported;
 }
 
+/**
+ * Reads a compressed maze, decoding it one row at a time straight into the walls
+ * of the maze, each row decoded against the one above it.
+ */
+bool importCompressed(Maze this, FILE *fp)
+{
+    bool imported;
+    int x;
+    struct scanner scanner;
+
+    imported = false;
+    scanner.block = NULL;
+    this->packed = false;
+    TRY( (this->walls = malloc(sizeof *this->walls * this->nx * this->ny)) );
+    TRY(allocateGrid(this));
+    TRY(openScanner(&scanner, fp));
+    for (x = 0; x < this->nx; x++)
+        TRY(decodeRow(&scanner, x ? this->walls + (size_t)(x - 1) * this->ny : NULL,
+            this->walls + (size_t)x * this->ny, this->ny));
+    imported = true;
+
+FINALLY:
+    closeScanner(&scanner);
+    return imported;
+}
+
+/**
+ * Reads the next byte of a compressed maze.
+ *
+ * \return The byte, or EOF at the end of the file.
+ */
+int scanByte(struct scanner *scanner)
+{
+    char *next, *end;
+
+    if (scanner->next == scanner->end && !fillScanner(scanner, &next, &end)) return EOF;
+    return (unsigned char)scanner->block[scanner->next++];
+}
+
+/**
+ * Reads a count written by putCount.
+ */
+bool scanCount(struct scanner *scanner, unsigned long *count)
+{
+    int byte, shift;
+
+    *count = 0;
+    for (shift = 0; shift < 35; shift += 7)
+    {
+        if ((byte = scanByte(scanner)) == EOF) return false;
+        *count |= (unsigned long)(byte & 127) << shift;
+        if ((byte & 128) == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * Decodes one row of a compressed maze, written by encodeRow.
+ *
+ * \param above The walls of the row above, or NULL for the first row.
+ */
+bool decodeRow(struct scanner *scanner, unsigned char *above, unsigned char *walls, int ny)
+{
+    bool decoded;
+    int y, bits;
+    unsigned long count, gap, position;
+
+    decoded = false;
+    for (y = bits = 0; y < ny; y++, bits >>= 2)
+    {
+        if ((y & 3) == 0) TRY( (bits = scanByte(scanner)) != EOF );
+        walls[y] = (bits & 1 ? EAST : 0) | (bits & 2 ? SOUTH : 0);
+        walls[y] = predictWalls(above, walls, y);
+    }
+    TRY(scanCount(scanner, &count) && count <= (unsigned long)ny);
+    for (position = 0; count > 0; count--)
+    {
+        TRY(scanCount(scanner, &gap) && gap < ny - position);
+        position += gap;
+        TRY( (bits = scanByte(scanner)) != EOF );
+        walls[position] ^= bits;
+    }
+    decoded = true;
+
+FINALLY:
+    return decoded;
+}
+
+/**
+ * Predicts the walls of a room from its own east and south walls, taking its
+ * north wall from the south wall of the room above it and its west wall from
+ * the east wall of the room before it, or a wall where it lies on the edge.
+ */
+int predictWalls(unsigned char *above, unsigned char *walls, int y)
+{
+    return (walls[y] & (EAST | SOUTH)) | (!above || (above[y] & SOUTH) ? NORTH : 0)
+        | (y == 0 || (walls[y - 1] & EAST) ? WEST : 0);
+}
+
+bool allocateGrid(Maze this)
+{
+    this->grid = calloc((size_t)this->nx * this->ny, sizeof *this->grid);
+    return this->grid != NULL;
+}
+
+bool exportRows(Maze this, FILE *fp);
+bool exportBinary(Maze this, FILE *fp);
 bool Maze_export(Maze this, char *filename)
 {
     bool exported;
-    int x, y;
     FILE *fp;
 
     exported = false;
     fp = NULL;
     TRY(this);
     if (strcmp(filename, "-") == 0) fp = stdout;
-    else TRY( (fp = fopen(filename, "w")) );
-    TRY(fprintf(fp, "%2d %2d\n", this->nx, this->ny) > 0);
-    TRY(fprintf(fp, "%2d %2d\n", getX(this, this->start), getY(this, this->start)) > 0);
-    TRY(fprintf(fp, "%2d %2d\n", getX(this, this->finish), getY(this, this->finish)) > 0);
+    else TRY( (fp = fopen(filename, "wb")) );
+    if (this->format == Maze_formatBinary) TRY(exportBinary(this, fp));
+    else TRY(exportRows(this, fp));
+    exported = true;
+
+FINALLY:
+    if (fp && fp != stdout) fclose(fp);
+    if (fp == stdout) fflush(stdout);
+    return exported;
+}
+
+bool writeHeader(FILE *fp, int format, int nx, int ny, int *start, int *finish, int flags);
+bool writeRow(FILE *fp, int format, char *line, unsigned char *above, unsigned char *walls, int ny);
+size_t encodeRow(unsigned char *line, unsigned char *above, unsigned char *walls, int ny);
+size_t putCount(unsigned char *next, unsigned long count);
+
+/**
+ * Writes a maze one row at a time, in the text or the compressed format.
+ */
+bool exportRows(Maze this, FILE *fp)
+{
+    bool exported;
+    int x, y, start[2], finish[2];
+    char *line;
+    unsigned char *walls, *above, *swap;
+
+    exported = false;
+    line = NULL;
+    walls = above = NULL;
+    TRY( (line = malloc(LINEBYTES(this->ny))) );
+    TRY( (walls = malloc(this->ny)) );
+    TRY( (above = malloc(this->ny)) );
+    start[0] = getX(this, this->start); start[1] = getY(this, this->start);
+    finish[0] = getX(this, this->finish); finish[1] = getY(this, this->finish);
+    TRY(writeHeader(fp, this->format, this->nx, this->ny, start, finish, 0));
     for (x = 0; x < this->nx; x++)
     {
         for (y = 0; y < this->ny; y++)
-            TRY(fprintf(fp, "%2d ", getRoom(this, x, y)->walls) > 0);
-        TRY(fprintf(fp, "\n") > 0);
+            walls[y] = getWallsAt(this, (size_t)x * this->ny + y);
+        TRY(writeRow(fp, this->format, line, x ? above : NULL, walls, this->ny));
+        swap = above; above = walls; walls = swap;
     }
-    TRY(fprintf(fp, "\n") > 0);
+    if (this->format == Maze_formatText) TRY(fprintf(fp, "\n") > 0);
     exported = true;
 
 FINALLY:
-    if (fp && fp != stdout) fclose(fp);
-    if (fp == stdout) fflush(stdout);
+    free(line);
+    free(walls);
+    free(above);
     return exported;
 }
 
+bool exportBinary(Maze this, FILE *fp)
+{
+    bool exported;
+    int start[2], finish[2];
+    size_t nbytes;
+
+    exported = false;
+    nbytes = wallBytes(this);
+    start[0] = getX(this, this->start); start[1] = getY(this, this->start);
+    finish[0] = getX(this, this->finish); finish[1] = getY(this, this->finish);
+    TRY(writeHeader(fp, Maze_formatBinary, this->nx, this->ny, start, finish,
+        this->packed ? BINARYPACKED : 0));
+    TRY(fwrite(this->walls, 1, nbytes, fp) == nbytes);
+    exported = true;
+
+FINALLY:
+    return exported;
+}
+
+/**
+ * Writes the header of a maze file. The start and finish rooms are given as
+ * their x and y coordinates.
+ */
+bool writeHeader(FILE *fp, int format, int nx, int ny, int *start, int *finish, int flags)
+{
+    struct header header;
+
+    if (format == Maze_formatText)
+        return fprintf(fp, "%2d %2d\n%2d %2d\n%2d %2d\n", nx, ny,
+            start[0], start[1], finish[0], finish[1]) > 0;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, format == Maze_formatCompressed ? COMPRESSEDMAGIC : BINARYMAGIC, sizeof header.magic);
+    header.nx = nx; header.ny = ny;
+    header.sx = start[0]; header.sy = start[1];
+    header.fx = finish[0]; header.fy = finish[1];
+    header.flags = flags;
+    return fwrite(&header, sizeof header, 1, fp) == 1;
+}
+
+/**
+ * Writes one row of rooms to a maze file. A text row is formatted into line,
+ * which must have room for LINEBYTES of the width, exactly as a "%2d " per room
+ * would format it, and written all at once; a compressed row is encoded into it
+ * against the row above, which is NULL for the first row.
+ */
+bool writeRow(FILE *fp, int format, char *line, unsigned char *above, unsigned char *walls, int ny)
+{
+    int y;
+    size_t length;
+    char *next;
+
+    if (format == Maze_formatBinary)
+        return fwrite(walls, 1, ny, fp) == (size_t)ny;
+    if (format == Maze_formatCompressed)
+    {
+        length = encodeRow((unsigned char *)line, above, walls, ny);
+        return fwrite(line, 1, length, fp) == length;
+    }
+    for (y = 0, next = line; y < ny; y++, next += 3)
+    {
+        next[0] = walls[y] < 10 ? ' ' : '0' + walls[y] / 10;
+        next[1] = '0' + walls[y] % 10;
+        next[2] = ' ';
+    }
+    *next++ = '\n';
+    return fwrite(line, 1, next - line, fp) == (size_t)(next - line);
+}
+
+/**
+ * Encodes one row of rooms of a compressed maze file. The east and south walls
+ * of every room are packed two bits to a room, four rooms to a byte, the east
+ * wall in the low bit and the first room in the low bits. The north and west
+ * walls are left out, as each is the same wall as the south wall of the room
+ * above or the east wall of the room before, and a maze is walled all around;
+ * the rooms whose walls differ from that follow, as a count of them and then,
+ * for each in turn, how many rooms on from the last it is and a byte of the
+ * bits that differ. Counts are written by putCount.
+ *
+ * \return The number of bytes written to line, at most LINEBYTES of the width.
+ */
+size_t encodeRow(unsigned char *line, unsigned char *above, unsigned char *walls, int ny)
+{
+    int y, last, residual;
+    unsigned long count;
+    unsigned char *next;
+
+    next = line;
+    for (y = 0; y < ny; y++)
+    {
+        if ((y & 3) == 0) *next++ = 0;
+        next[-1] |= (((walls[y] & EAST) != 0) | ((walls[y] & SOUTH) != 0) << 1) << ((y & 3) << 1);
+    }
+    for (y = 0, count = 0; y < ny; y++)
+        if (walls[y] != predictWalls(above, walls, y)) count++;
+    next += putCount(next, count);
+    for (y = 0, last = 0; count > 0; y++)
+        if ((residual = walls[y] ^ predictWalls(above, walls, y)) != 0)
+        {
+            next += putCount(next, y - last);
+            *next++ = residual;
+            last = y;
+            count--;
+        }
+    return next - line;
+}
+
+/**
+ * Writes a count seven bits to a byte, lowest first, setting the high bit of
+ * every byte but the last.
+ *
+ * \return The number of bytes written.
+ */
+size_t putCount(unsigned char *next, unsigned long count)
+{
+    size_t length;
+
+    for (length = 0; count >= 128; count >>= 7) next[length++] = (count & 127) | 128;
+    next[length++] = count;
+    return length;
+}
+
+void Maze_setFormat(Maze this, int format) { if (this) this->format = format; }
+int Maze_getFormat(Maze this) { return this? this->format : Maze_formatAuto; }
+
+struct mazewriter
+{
+    FILE *fp;
+    int format, nx, ny, row;
+    int start[2], finish[2];
+    char *line;
+    unsigned char *above;
+};
+
+MazeWriter MazeWriter_open(char *filename, int format, int x, int y)
+{
+    bool opened;
+    MazeWriter this;
+
+    opened = false;
+    this = NULL;
+    TRY(x > 0 && y > 0);
+    TRY( (this = malloc(sizeof *this)) );
+    this->fp = NULL;
+    this->format = format;
+    this->nx = x; this->ny = y;
+    this->row = 0;
+    this->start[0] = this->start[1] = this->finish[0] = this->finish[1] = 0;
+    this->line = NULL;
+    this->above = NULL;
+    TRY( (this->line = malloc(LINEBYTES(y))) );
+    TRY( (this->above = malloc(y)) );
+    if (strcmp(filename, "-") == 0) this->fp = stdout;
+    else TRY( (this->fp = fopen(filename, "wb")) );
+    opened = true;
+
+FINALLY:
+    if (!opened) MazeWriter_close(&this);
+    return this;
+}
+
+void MazeWriter_setStart(MazeWriter this, int x, int y) { this->start[0] = x; this->start[1] = y; }
+void MazeWriter_setFinish(MazeWriter this, int x, int y) { this->finish[0] = x; this->finish[1] = y; }
+
+bool MazeWriter_writeRow(MazeWriter this, unsigned char *walls)
+{
+    bool written;
+
+    written = false;
+    TRY(this->row < this->nx);
+    if (this->row == 0)
+        TRY(writeHeader(this->fp, this->format, this->nx, this->ny, this->start, this->finish, 0));
+    TRY(writeRow(this->fp, this->format, this->line, this->row ? this->above : NULL, walls, this->ny));
+    memcpy(this->above, walls, this->ny);
+    this->row++;
+    written = true;
+
+FINALLY:
+    return written;
+}
+
+bool MazeWriter_close(MazeWriter *this)
+{
+    bool closed;
+
+    closed = false;
+    TRY(*this && (*this)->fp && (*this)->row == (*this)->nx);
+    if ((*this)->format == Maze_formatText) TRY(fprintf((*this)->fp, "\n") > 0);
+    closed = true;
+
+FINALLY:
+    if (*this)
+    {
+        if ((*this)->fp == stdout) closed = fflush(stdout) == 0 && closed;
+        else if ((*this)->fp) closed = fclose((*this)->fp) == 0 && closed;
+        free((*this)->line);
+        free((*this)->above);
+    }
+    free(*this);
+    *this = NULL;
+    return closed;
+}
+
+struct mazereader
+{
+    FILE *fp;
+    int format, row, nibble;
+    struct header header;
+    struct scanner scanner;
+    unsigned char *above;
+};
+
+bool printBorder(FILE *stream, char *line, unsigned char *walls, int ny, int wall);
+bool printMeat(FILE *stream, char *line, unsigned char *walls, char *markers, int ny);
+MazeReader MazeReader_open(char *filename)
+{
+    bool opened;
+    MazeReader this;
+
+    opened = false;
+    TRY( (this = malloc(sizeof *this)) );
+    this->fp = NULL;
+    this->row = 0;
+    this->nibble = -1;
+    this->scanner.block = NULL;
+    this->above = NULL;
+    if (strcmp(filename, "-") == 0) this->fp = stdin;
+    else TRY( (this->fp = fopen(filename, "rb")) );
+    TRY( (this->format = detectFormat(this->fp)) );
+    TRY(readHeader(this->fp, &this->format, &this->header));
+    /* the start and finish must be rooms of the maze, as Maze_import requires */
+    TRY(this->header.sx >= 0 && this->header.sx < this->header.nx);
+    TRY(this->header.sy >= 0 && this->header.sy < this->header.ny);
+    TRY(this->header.fx >= 0 && this->header.fx < this->header.nx);
+    TRY(this->header.fy >= 0 && this->header.fy < this->header.ny);
+    if (this->format != Maze_formatBinary) TRY(openScanner(&this->scanner, this->fp));
+    if (this->format == Maze_formatCompressed) TRY( (this->above = malloc(this->header.ny)) );
+    opened = true;
+
+FINALLY:
+    if (!opened) MazeReader_close(&this);
+    return this;
+}
+
+int MazeReader_getHeight(MazeReader this) { return this->header.nx; }
+int MazeReader_getWidth(MazeReader this) { return this->header.ny; }
+void MazeReader_getStart(MazeReader this, int *x, int *y) { *x = this->header.sx; *y = this->header.sy; }
+void MazeReader_getFinish(MazeReader this, int *x, int *y) { *x = this->header.fx; *y = this->header.fy; }
+
+bool MazeReader_readRow(MazeReader this, unsigned char *walls)
+{
+    bool read;
+    int y, value;
+
+    read = false;
+    TRY(this->row < this->header.nx);
+    if (this->format == Maze_formatText)
+        TRY(scanWalls(&this->scanner, walls, this->header.ny));
+    else if (this->format == Maze_formatCompressed)
+    {
+        TRY(decodeRow(&this->scanner, this->row ? this->above : NULL, walls, this->header.ny));
+        memcpy(this->above, walls, this->header.ny);
+    }
+    else if ((this->header.flags & BINARYPACKED) == 0)
+        TRY(fread(walls, 1, this->header.ny, this->fp) == (size_t)this->header.ny);
+    else
+        for (y = 0; y < this->header.ny; y++)
+        {
+            if (this->nibble < 0)
+            {
+                TRY( (value = getc(this->fp)) != EOF );
+                walls[y] = value & 15;
+                this->nibble = value >> 4;
+            }
+            else
+            {
+                walls[y] = this->nibble;
+                this->nibble = -1;
+            }
+        }
+    this->row++;
+    read = true;
+
+FINALLY:
+    return read;
+}
+
+bool MazeReader_print(MazeReader this, FILE *stream)
+{
+    bool printed;
+    int x, y, ny;
+    char *line, *markers;
+    unsigned char *walls;
+
+    printed = false;
+    ny = this->header.ny;
+    line = markers = NULL;
+    walls = NULL;
+    TRY( (line = malloc(4 * (size_t)ny + 2)) );
+    TRY( (markers = malloc(ny)) );
+    TRY( (walls = malloc(ny)) );
+    for (x = this->row; x < this->header.nx; x++)
+    {
+        TRY(MazeReader_readRow(this, walls));
+        for (y = 0; y < ny; y++) markers[y] = Room_cleared;
+        /* the start is drawn over the finish when they share a room, as Maze_fprint does */
+        if (x == this->header.fx) markers[this->header.fy] = 'F';
+        if (x == this->header.sx) markers[this->header.sy] = 'S';
+        if (x == 0) TRY(printBorder(stream, line, walls, ny, NORTH));
+        TRY(printMeat(stream, line, walls, markers, ny));
+        TRY(printBorder(stream, line, walls, ny, SOUTH));
+    }
+    printed = true;
+
+FINALLY:
+    free(line);
+    free(markers);
+    free(walls);
+    return printed;
+}
+
+void MazeReader_close(MazeReader *this)
+{
+    if (*this && (*this)->fp && (*this)->fp != stdin)
+        fclose((*this)->fp);
+    if (*this)
+    {
+        closeScanner(&(*this)->scanner);
+        free((*this)->above);
+    }
+    free(*this);
+    *this = NULL;
+}
+
 bool Maze_copy(Maze destination, Maze source)
 {
     bool copied;
     int x, y;
-    size_t gridbytes;
+    size_t gridbytes, wallbytes;
 
     copied = false;
     TRY(destination && source);
     gridbytes = (sizeof *source->grid * source->nx * source->ny);
+    wallbytes = wallBytes(source);
     memcpy(destination, source, sizeof *source);
+    destination->walls = NULL;
+    destination->map = NULL;
+    destination->mapsize = 0;
     TRY( (destination->grid = malloc(gridbytes)) );
     memcpy(destination->grid, source->grid, gridbytes);
+    TRY( (destination->walls = malloc(wallbytes)) );
+    memcpy(destination->walls, source->walls, wallbytes);
     x = getX(source, source->start); y = getY(source, source->start);
     destination->start = getRoom(destination, x, y);
     x = getX(source, source->finish); y = getY(source, source->finish);
@@ -126,53 +894,100 @@ FINALLY:
     return copied;
 }
 
-void printBorder(Maze this, int x, int wall);
-void printMeat(Maze this, int x);
-void Maze_print(Maze this)
+void Maze_print(Maze this) { Maze_fprint(this, stdout); }
+
+void Maze_fprint(Maze this, FILE *stream)
 {
-    int x;
+    Maze_fprintRegion(this, stream, 0, 0, this->nx, this->ny);
+}
 
-    printBorder(this, 0, NORTH);
-    for (x = 0; x < this->nx; x++)
+void Maze_fprintRegion(Maze this, FILE *stream, int top, int left, int nrows, int ncols)
+{
+    int x, y;
+    char *line, *markers;
+    unsigned char *walls;
+    Room room;
+
+    line = markers = NULL;
+    walls = NULL;
+    TRY( (line = malloc(4 * (size_t)ncols + 2)) );
+    TRY( (markers = malloc(ncols)) );
+    TRY( (walls = malloc(ncols)) );
+    for (x = top; x < top + nrows; x++)
     {
-        printMeat(this, x);
-        printBorder(this, x, SOUTH);
+        for (y = 0; y < ncols; y++)
+        {
+            room = getRoom(this, x, left + y);
+            walls[y] = getWalls(this, room);
+            if (room == Maze_getStart(this)) markers[y] = 'S';
+            else if (room == Maze_getFinish(this)) markers[y] = 'F';
+            else markers[y] = Maze_getMarker(room);
+        }
+        if (x == top) TRY(printBorder(stream, line, walls, ncols, NORTH));
+        TRY(printMeat(stream, line, walls, markers, ncols));
+        TRY(printBorder(stream, line, walls, ncols, SOUTH));
     }
+
+FINALLY:
+    free(line);
+    free(markers);
+    free(walls);
+}
+
+int Maze_fprintRoomAt(Maze this, FILE *stream, int offset, int top, int left)
+{
+    char marker;
+    Room room;
+
+    room = &this->grid[offset];
+    if (room == Maze_getStart(this)) marker = 'S';
+    else if (room == Maze_getFinish(this)) marker = 'F';
+    else marker = Maze_getMarker(room);
+    /* two lines to a row of rooms below the top border, four columns to a room */
+    return fprintf(stream, "\033[%i;%iH%c", 2 * (getX(this, room) - top) + 2, 4 * (getY(this, room) - left) + 3,
+        marker);
 }
 
-void printBorder(Maze this, int x, int wall)
+/**
+ * Prints the border above or below a row of rooms. Every line of a printed maze
+ * is built in line, which must have room for 4 characters per room and two
+ * more, and written all at once.
+ */
+bool printBorder(FILE *stream, char *line, unsigned char *walls, int ny, int wall)
 {
     int y;
+    char *next;
 
-    printf("+");
-    for (y = 0; y < this->ny; y++)
+    next = line;
+    *next++ = '+';
+    for (y = 0; y < ny; y++)
     {
-        if ((getRoom(this, x, y)->walls & wall) != 0)
-            printf("---");
-        else
-            printf("   ");
-        printf("+");
+        memcpy(next, (walls[y] & wall) != 0 ? "---+" : "   +", 4);
+        next += 4;
     }
-    printf("\n");
+    *next++ = '\n';
+    return fwrite(line, 1, next - line, stream) == (size_t)(next - line);
 }
 
-void printMeat(Maze this, int x)
+/**
+ * Prints a row of rooms, each room showing its character from markers.
+ */
+bool printMeat(FILE *stream, char *line, unsigned char *walls, char *markers, int ny)
 {
     int y;
-    Room room;
+    char *next;
 
-    if ((getRoom(this, x, 0)->walls & WEST) != 0) printf("|");
-    else printf(" ");
-    for (y = 0; y < this->ny; y++)
+    next = line;
+    *next++ = (walls[0] & WEST) != 0 ? '|' : ' ';
+    for (y = 0; y < ny; y++)
     {
-        room = getRoom(this, x, y);
-        if (room == Maze_getStart(this)) printf(" S ");
-        else if (room == Maze_getFinish(this)) printf(" F ");
-        else printf(" %c ", Maze_getMarker(room));
-        if ((room->walls & EAST) != 0) printf("|");
-        else printf(" ");
+        *next++ = ' ';
+        *next++ = markers[y];
+        *next++ = ' ';
+        *next++ = (walls[y] & EAST) != 0 ? '|' : ' ';
     }
-    printf("\n");
+    *next++ = '\n';
+    return fwrite(line, 1, next - line, stream) == (size_t)(next - line);
 }
 
 Room Maze_getStart(Maze this) { return this? this->start : NULL; }
@@ -182,28 +997,42 @@ void Maze_setFinish(Maze this, Room room) { if (this) this->finish = room; }
 
 int Maze_getAdjacent(Maze this, Room room, Room *adjacent, bool walls)
 {
-    int x, y, count;
+    int i, count, offsets[4];
 
     count = 0;
     adjacent[0] = adjacent[1] = adjacent[2] = adjacent[3] = NULL;
     TRY(this && this->grid && room);
-    x = getX(this, room);
-    y = getY(this, room);
-    if (hasWall(room, NORTH) == walls)
-        if ( (adjacent[count] = getRoom(this, x - 1, y)) ) count++;
-    if (hasWall(room, EAST) == walls)
-        if ( (adjacent[count] = getRoom(this, x, y + 1)) ) count++;
-    if (hasWall(room, SOUTH) == walls)
-        if ( (adjacent[count] = getRoom(this, x + 1, y)) ) count++;
-    if (hasWall(room, WEST) == walls)
-        if ( (adjacent[count] = getRoom(this, x, y - 1)) ) count++;
+    count = Maze_getAdjacentAt(this, room - this->grid, offsets, walls);
+    for (i = 0; i < count; i++) adjacent[i] = &this->grid[offsets[i]];
 
 FINALLY:
     return count;
 }
 
-void Maze_setMarker(Room room, char marker) { room->marker = marker; }
-char Maze_getMarker(Room room) { return room->marker; }
+int Maze_getAdjacentAt(Maze this, int offset, int *adjacent, bool walls)
+{
+    int y, count, standing;
+
+    count = 0;
+    adjacent[0] = adjacent[1] = adjacent[2] = adjacent[3] = -1;
+    y = offset % this->ny;
+    standing = getWallsAt(this, offset);
+    if (((standing & NORTH) != 0) == walls && offset >= this->ny)
+        adjacent[count++] = offset - this->ny;
+    if (((standing & EAST) != 0) == walls && y < this->ny - 1)
+        adjacent[count++] = offset + 1;
+    if (((standing & SOUTH) != 0) == walls && offset < Maze_getRoomCount(this) - this->ny)
+        adjacent[count++] = offset + this->ny;
+    if (((standing & WEST) != 0) == walls && y > 0)
+        adjacent[count++] = offset - 1;
+    return count;
+}
+
+void Maze_setMarkerAt(Maze this, int offset, char marker) { Maze_setMarker(&this->grid[offset], marker); }
+char Maze_getMarkerAt(Maze this, int offset) { return Maze_getMarker(&this->grid[offset]); }
+
+void Maze_setMarker(Room room, char marker) { room->marker = marker == Room_cleared ? 0 : marker; }
+char Maze_getMarker(Room room) { return room->marker ? room->marker : Room_cleared; }
 void Maze_replaceMarkers(Maze this, char find, char replace)
 {
     int x, y;
@@ -217,23 +1046,32 @@ void Maze_replaceMarkers(Maze this, char find, char replace)
         }
 }
 
-Maze Maze_newFilled(int x, int y)
+int Maze_getHeight(Maze this) { return this->nx; }
+int Maze_getWidth(Maze this) { return this->ny; }
+int Maze_getRoomCount(Maze this) { return this->nx * this->ny; }
+int Maze_getOffset(Maze this, Room room) { return room - this->grid; }
+Room Maze_getRoomAt(Maze this, int offset)
+{
+    return offset >= 0 && offset < Maze_getRoomCount(this) ? &this->grid[offset] : NULL;
+}
+int Maze_getWallsAt(Maze this, int offset) { return getWallsAt(this, offset); }
+
+Maze newFilled(int x, int y, bool packed);
+Maze Maze_newFilled(int x, int y) { return newFilled(x, y, false); }
+Maze Maze_newPacked(int x, int y) { return newFilled(x, y, true); }
+Maze newFilled(int x, int y, bool packed)
 {
     bool created;
     Maze this;
-    Room room;
 
     created = false;
     TRY( (this = Maze_new()) );
     this->nx = x; this->ny = y;
-    TRY( (this->grid = malloc(sizeof *this->grid * this->nx * this->ny)) );
-    for (x = 0; x < this->nx; x++)
-        for (y = 0; y < this->ny; y++)
-        {
-            room = getRoom(this, x, y);
-            room->walls = NORTH + EAST + SOUTH + WEST;
-            Maze_setMarker(room, Room_cleared);
-        }
+    this->packed = packed;
+    TRY( (this->walls = malloc(wallBytes(this))) );
+    if (packed) memset(this->walls, 0xFF, wallBytes(this));
+    else memset(this->walls, NORTH + EAST + SOUTH + WEST, wallBytes(this));
+    TRY(allocateGrid(this));
     this->start = this->finish = this->grid;
     created = true;
 
@@ -242,28 +1080,92 @@ FINALLY:
     return this;
 }
 
-Room Maze_getRandomRoom(Maze this)
+bool Maze_refill(Maze this, int x, int y)
+{
+    bool refilled;
+    size_t nrooms;
+    Room grid;
+    unsigned char *walls;
+
+    refilled = false;
+    nrooms = (size_t)x * y;
+    if (this->map)
+    {
+        munmap(this->map, this->mapsize);
+        this->map = NULL;
+        this->walls = NULL;
+        this->nx = this->ny = 0;
+    }
+    if (nrooms > (size_t)this->nx * this->ny || !this->walls)
+    {
+        this->nx = this->ny = 0;
+        TRY( (grid = realloc(this->grid, nrooms * sizeof *grid)) );
+        this->grid = grid;
+        TRY( (walls = realloc(this->walls, nrooms)) );
+        this->walls = walls;
+    }
+    this->nx = x; this->ny = y;
+    memset(this->grid, 0, nrooms * sizeof *this->grid);
+    if (this->packed) memset(this->walls, 0xFF, wallBytes(this));
+    else memset(this->walls, NORTH + EAST + SOUTH + WEST, wallBytes(this));
+    this->start = this->finish = this->grid;
+    refilled = true;
+
+FINALLY:
+    return refilled;
+}
+
+Room Maze_getRandomRoom(Maze this, struct rng *rng)
 {
     int x, y;
-    x = rand() % this->nx;
-    y = rand() % this->ny;
+    x = Rng_below(rng, this->nx);
+    y = Rng_below(rng, this->ny);
     return getRoom(this, x, y); }
 
 bool Maze_tunnel(Maze this, Room from, Room to)
 {
-    int fx, fy, tx, ty, direction;
+    return Maze_tunnelAt(this, from - this->grid, to - this->grid);
+}
+
+/**
+ * Finds the direction of one room from another.
+ *
+ * \return The wall of from that faces to, or 0 if the rooms are not adjacent.
+ */
+int findDirection(Maze this, int from, int to)
+{
+    if (to == from - this->ny) return NORTH;
+    if (to == from + this->ny) return SOUTH;
+    if (to == from - 1 && from % this->ny > 0) return WEST;
+    if (to == from + 1 && to % this->ny > 0) return EAST;
+    return 0;
+}
+
+bool Maze_tunnelAt(Maze this, int from, int to)
+{
+    int direction;
 
-    direction = 0;
-    fx = getX(this, from); fy = getY(this, from);
-    tx = getX(this, to);   ty = getY(this, to);
-    if      (fx - 1 == tx && fy == ty) direction = NORTH;
-    else if (fx + 1 == tx && fy == ty) direction = SOUTH;
-    else if (fx == tx && fy - 1 == ty) direction = WEST;
-    else if (fx == tx && fy + 1 == ty) direction = EAST;
-    if (direction)
+    if ((direction = findDirection(this, from, to)))
     {
-        from->walls &= ~direction;
-        to->walls &= ~(opposite(direction));
+        setWallsAt(this, from, getWallsAt(this, from) & ~direction);
+        setWallsAt(this, to, getWallsAt(this, to) & ~(opposite(direction)));
+    }
+    return direction != false;
+}
+
+bool Maze_addWall(Maze this, Room from, Room to)
+{
+    return Maze_addWallAt(this, from - this->grid, to - this->grid);
+}
+
+bool Maze_addWallAt(Maze this, int from, int to)
+{
+    int direction;
+
+    if ((direction = findDirection(this, from, to)))
+    {
+        setWallsAt(this, from, getWallsAt(this, from) | direction);
+        setWallsAt(this, to, getWallsAt(this, to) | opposite(direction));
     }
     return direction != false;
 }
@@ -271,7 +1173,11 @@ bool Maze_tunnel(Maze this, Room from, Room to)
 void Maze_free(Maze *this)
 {
     if (*this)
+    {
         free((*this)->grid);
+        if ((*this)->map) munmap((*this)->map, (*this)->mapsize);
+        else free((*this)->walls);
+    }
     free(*this);
     *this = NULL;
 }
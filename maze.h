@@ -13,7 +13,10 @@
 #ifndef MAZE_HEADER
 #define MAZE_HEADER
 
+#include <stdio.h>
+
 #include "bool.h"
+#include "rng.h"
 
 /**
  * These characters can be used to mark a room. They are defined purely for
@@ -24,6 +27,17 @@
 #define Room_visited 'O'
 #define Room_deadend 'X'
 
+/**
+ * The file formats a maze can be imported from and exported to. The MDF is the
+ * text format described at Maze_import, and the binary and compressed formats
+ * are described at Maze_importAs. Maze_formatAuto lets the import detect the
+ * format on its own.
+ */
+#define Maze_formatAuto       0
+#define Maze_formatText       1
+#define Maze_formatBinary     2
+#define Maze_formatCompressed 3
+
 /**
  * Opaque pointers that hold the storage data. This implementation provides two
  * conceptual data structures: the maze and the room. A maze is made up of many
@@ -34,6 +48,18 @@
 typedef struct room *Room;
 typedef struct maze *Maze;
 
+/**
+ * Opaque pointer to a maze file being written one row of rooms at a time. See
+ * MazeWriter_open.
+ */
+typedef struct mazewriter *MazeWriter;
+
+/**
+ * Opaque pointer to a maze file being read one row of rooms at a time. See
+ * MazeReader_open.
+ */
+typedef struct mazereader *MazeReader;
+
 /**
  * Constructor that initializes a maze variable. This function prepares a maze
  * variable for importing or copying. Printing a maze that is not imported or
@@ -91,6 +117,9 @@ Maze Maze_new(void);
  *              |         S     |
  *              +---+---+---+---+
  *
+ * Binary and compressed maze files are also accepted; the format of the file is
+ * detected automatically. See Maze_importAs.
+ *
  * \param this The maze to import to. Must have been initalized with Maze_new.
  * \param filename The filename of the MDF to read into the maze.
  *
@@ -98,11 +127,41 @@ Maze Maze_new(void);
  */
 bool Maze_import(Maze this, char *filename);
 
+/**
+ * Imports a maze from a file of a given format. The binary format is a header
+ * of the characters "MAZB" and seven ints in host byte order (x, y, sx, sy, fx,
+ * fy, and flags), followed by one byte of wall values per room in the same
+ * order as the MDF. If bit 1 of the flags is set, the wall values are packed two
+ * rooms to a byte instead, the first room in the low nibble, and the maze is
+ * imported as a packed maze (see Maze_newPacked). A binary file is mapped into memory and used as the
+ * maze directly where possible, so it is not parsed at all.
+ *
+ * The compressed format has the same header but starts with "MAZC", and every
+ * wall inside the maze is stored once rather than once for each room it
+ * divides. Each row holds the east and south walls of its rooms, two bits to a
+ * room and four rooms to a byte, the first room in the low bits; the north and
+ * west walls are taken from the rooms above and before, or are walls at the
+ * edge of the maze. The few rooms whose walls differ from that are listed after
+ * the row as exceptions, so any maze is stored exactly, at about a quarter of a
+ * byte per room. The file is read in blocks, decoding one row at a time. A file
+ * asked to be read as binary is read as compressed if it is.
+ *
+ * \param this The maze to import to. Must have been initalized with Maze_new.
+ * \param filename The filename of the file to read into the maze.
+ * \param format One of Maze_formatAuto, Maze_formatText, Maze_formatBinary or
+ *     Maze_formatCompressed.
+ *
+ * \return true if the import was successful, false if not.
+ */
+bool Maze_importAs(Maze this, char *filename, int format);
+
 /**
  * Exports a maze to the MDF format. See the Maze_import documentation for the
- * description of this format. Note that this function may create or overwrite
- * any file that shares a name with its filename parameter. This function may
- * also leave a bad MDF behind if the export was unsuccessful.
+ * description of this format. A maze imported from a binary file is exported
+ * in the binary format instead, unless told otherwise with Maze_setFormat. Note
+ * that this function may create or overwrite any file that shares a name with
+ * its filename parameter. This function may also leave a bad MDF behind if the
+ * export was unsuccessful.
  *
  * \param this The maze to export.
  * \param filename The filename of the file to export to.
@@ -111,6 +170,163 @@ bool Maze_import(Maze this, char *filename);
  */
 bool Maze_export(Maze this, char *filename);
 
+/**
+ * Sets the format that Maze_export writes a maze in.
+ *
+ * \param this The maze to set the format of.
+ * \param format Maze_formatText, Maze_formatBinary or Maze_formatCompressed.
+ */
+void Maze_setFormat(Maze this, int format);
+
+/**
+ * Gets the format that Maze_export writes a maze in. This is the format the
+ * maze was imported from, unless changed with Maze_setFormat.
+ *
+ * \param this The maze to get the format of.
+ *
+ * \return Maze_formatText, Maze_formatBinary or Maze_formatCompressed.
+ */
+int Maze_getFormat(Maze this);
+
+/**
+ * Opens a maze file to be written one row at a time, without the maze ever
+ * being held in memory. The rows are written in order with MazeWriter_writeRow,
+ * and the file is finished with MazeWriter_close. This function may create or
+ * overwrite any file that shares a name with its filename parameter.
+ *
+ * \param filename The filename of the file to write, or "-" for the standard
+ *     output.
+ * \param format Maze_formatText, Maze_formatBinary or Maze_formatCompressed.
+ * \param x The height of the maze.
+ * \param y The width of the maze.
+ *
+ * \return A new maze writer or, if the file could not be opened, NULL.
+ */
+MazeWriter MazeWriter_open(char *filename, int format, int x, int y);
+
+/**
+ * Sets the coordinates of the start room of the maze being written. This must
+ * be done before the first row is written.
+ *
+ * \param this The writer to set the start room of.
+ * \param x The row of the start room.
+ * \param y The column of the start room.
+ */
+void MazeWriter_setStart(MazeWriter this, int x, int y);
+
+/**
+ * Sets the coordinates of the finish room of the maze being written. This must
+ * be done before the first row is written.
+ *
+ * \param this The writer to set the finish room of.
+ * \param x The row of the finish room.
+ * \param y The column of the finish room.
+ */
+void MazeWriter_setFinish(MazeWriter this, int x, int y);
+
+/**
+ * Writes the next row of rooms. The row is written to the file as soon as this
+ * function is called.
+ *
+ * \param this The writer to write to.
+ * \param walls The wall values of each room of the row, as described at
+ *     Maze_import; one for each room in the width of the maze.
+ *
+ * \return true if the row was written, false if not.
+ */
+bool MazeWriter_writeRow(MazeWriter this, unsigned char *walls);
+
+/**
+ * Finishes and closes a maze file, frees the writer and sets the variable to
+ * NULL. This function is safe to call on writers that failed.
+ *
+ * \param this The writer to close.
+ *
+ * \return true if every row of the maze was written and the file was closed
+ *     successfully, false if not.
+ */
+bool MazeWriter_close(MazeWriter *this);
+
+/**
+ * Opens a maze file of any format to be read one row at a time, without the
+ * maze ever being held in memory. The header of the file is read right away.
+ *
+ * \param filename The filename of the file to read, or "-" for the standard
+ *     input.
+ *
+ * \return A new maze reader or, if the file could not be opened or does not
+ *     start with a valid header, whose start and finish are rooms of the maze,
+ *     NULL.
+ */
+MazeReader MazeReader_open(char *filename);
+
+/**
+ * Gets the height of the maze being read, in rooms.
+ *
+ * \param this The reader to get the height of.
+ *
+ * \return The height of the maze.
+ */
+int MazeReader_getHeight(MazeReader this);
+
+/**
+ * Gets the width of the maze being read, in rooms.
+ *
+ * \param this The reader to get the width of.
+ *
+ * \return The width of the maze.
+ */
+int MazeReader_getWidth(MazeReader this);
+
+/**
+ * Gets the coordinates of the start room of the maze being read.
+ *
+ * \param this The reader to get the start room of.
+ * \param x Set to the row of the start room.
+ * \param y Set to the column of the start room.
+ */
+void MazeReader_getStart(MazeReader this, int *x, int *y);
+
+/**
+ * Gets the coordinates of the finish room of the maze being read.
+ *
+ * \param this The reader to get the finish room of.
+ * \param x Set to the row of the finish room.
+ * \param y Set to the column of the finish room.
+ */
+void MazeReader_getFinish(MazeReader this, int *x, int *y);
+
+/**
+ * Reads the next row of rooms.
+ *
+ * \param this The reader to read from.
+ * \param walls Filled with the wall values of each room of the row, as
+ *     described at Maze_import; it must have space for the width of the maze.
+ *
+ * \return true if a row was read, false if there are no rows left or the file
+ *     is bad.
+ */
+bool MazeReader_readRow(MazeReader this, unsigned char *walls);
+
+/**
+ * Prints the rows left in a maze file exactly as Maze_print would print the
+ * maze, one row at a time, so that mazes larger than memory can be displayed.
+ *
+ * \param this The reader to print from.
+ * \param stream The stream to print to.
+ *
+ * \return true if the whole maze was printed, false if not.
+ */
+bool MazeReader_print(MazeReader this, FILE *stream);
+
+/**
+ * Closes a maze file, frees the reader and sets the variable to NULL. This
+ * function is safe to call on readers that failed to open.
+ *
+ * \param this The reader to close.
+ */
+void MazeReader_close(MazeReader *this);
+
 /**
  * Performs a deep copy of a maze. This function copies all values, allocates
  * space for them, etc. This is not a shallow copy. The destination maze may
@@ -132,6 +348,47 @@ bool Maze_copy(Maze destination, Maze source);
  */
 void Maze_print(Maze this);
 
+/**
+ * Prints a maze to a given stream, as Maze_print does to the standard output.
+ * Each line is built in a buffer and written out whole.
+ *
+ * \param this The maze to display.
+ * \param stream The stream to print to.
+ */
+void Maze_fprint(Maze this, FILE *stream);
+
+/**
+ * Prints a block of rooms of a maze to a given stream, drawn as Maze_fprint
+ * draws the whole maze, so that a maze too large for a terminal can be shown a
+ * part at a time.
+ *
+ * \param this The maze to display.
+ * \param stream The stream to print to.
+ * \param top The row of the first room to print.
+ * \param left The column of the first room to print.
+ * \param nrows The number of rows of rooms to print.
+ * \param ncols The number of columns of rooms to print.
+ */
+void Maze_fprintRegion(Maze this, FILE *stream, int top, int left, int nrows, int ncols);
+
+/**
+ * Redraws one room of a block of a maze printed by Maze_fprintRegion (or of a
+ * whole maze printed by Maze_fprint) at the top left corner of a terminal,
+ * moving the cursor to the room with an ANSI escape sequence and writing only
+ * its character, so that a drawing can follow the markers as they change
+ * without the maze being printed again. The room must lie in the block printed.
+ *
+ * \param this The maze.
+ * \param stream The stream the maze was printed to.
+ * \param offset The offset of the room to redraw.
+ * \param top The row of the first room printed.
+ * \param left The column of the first room printed.
+ *
+ * \return The number of characters written, or a negative number if they could
+ *     not be written.
+ */
+int Maze_fprintRoomAt(Maze this, FILE *stream, int offset, int top, int left);
+
 /**
  * Gets the start room of the maze.
  *
@@ -200,6 +457,106 @@ char Maze_getMarker(Room room);
  */
 void Maze_replaceMarkers(Maze this, char find, char replace);
 
+/**
+ * Gets the height of the maze, in rooms.
+ *
+ * \param this The maze to get the height of.
+ *
+ * \return The height of the maze.
+ */
+int Maze_getHeight(Maze this);
+
+/**
+ * Gets the width of the maze, in rooms.
+ *
+ * \param this The maze to get the width of.
+ *
+ * \return The width of the maze.
+ */
+int Maze_getWidth(Maze this);
+
+/**
+ * Gets the number of rooms in the maze. Every room has an offset from 0 up to
+ * (but not including) this number, which allows per-room bookkeeping to be
+ * kept in plain arrays outside of the maze.
+ *
+ * \param this The maze to count the rooms of.
+ *
+ * \return The number of rooms in the maze.
+ */
+int Maze_getRoomCount(Maze this);
+
+/**
+ * Gets the offset of a room within the maze. See Maze_getRoomCount.
+ *
+ * \param this The maze the room belongs to.
+ * \param room The room to get the offset of.
+ *
+ * \return The offset of the room.
+ */
+int Maze_getOffset(Maze this, Room room);
+
+/**
+ * Gets the room at a given offset within the maze. See Maze_getRoomCount.
+ *
+ * \param this The maze to get the room from.
+ * \param offset The offset of the room.
+ *
+ * \return The room, or NULL if the offset is out of range.
+ */
+Room Maze_getRoomAt(Maze this, int offset);
+
+/**
+ * Gets the walls of the room at a given offset, as the sum of the values of the
+ * walls standing, as in an MDF. Unlike Maze_getAdjacent, this does no division
+ * or bounds checks, so it is meant for building other views of a maze quickly.
+ *
+ * \param this The maze to get the walls from.
+ * \param offset The offset of the room, which must be in range.
+ *
+ * \return The walls of the room.
+ */
+int Maze_getWallsAt(Maze this, int offset);
+
+/**
+ * Gets the rooms adjacent to a room, as Maze_getAdjacent does, but with every
+ * room known by its offset rather than a Room. Offsets fit in 32 bits and mean
+ * the same thing in any maze of the same size, so searches can keep their
+ * queues and parent arrays as plain arrays of int, and several threads can
+ * search one maze without sharing any room pointers. Unused slots up to 4 are
+ * set to -1.
+ *
+ * \param this The maze to get the adjacent rooms from.
+ * \param offset The offset of the room, which must be in range.
+ * \param adjacent The array which will be populated with the offsets of the
+ *     adjacent rooms.
+ * \param walls As in Maze_getAdjacent.
+ *
+ * \return The number of rooms added to the array.
+ */
+int Maze_getAdjacentAt(Maze this, int offset, int *adjacent, bool walls);
+
+/**
+ * Sets the character marker of the room at a given offset, as Maze_setMarker
+ * does.
+ *
+ * \param this The maze the room belongs to.
+ * \param offset The offset of the room, which must be in range.
+ * \param marker The character marker.
+ */
+void Maze_setMarkerAt(Maze this, int offset, char marker);
+
+/**
+ * Gets the character marker of the room at a given offset, as Maze_getMarker
+ * does.
+ *
+ * \param this The maze the room belongs to.
+ * \param offset The offset of the room, which must be in range.
+ *
+ * \return The character marker.
+ */
+char Maze_getMarkerAt(Maze this, int offset);
+
 /*****************************
  * GENERATION ONLY FUNCTIONS *
  *****************************/
@@ -216,6 +573,38 @@ void Maze_replaceMarkers(Maze this, char find, char replace);
  */
 Maze Maze_newFilled(int x, int y);
 
+/**
+ * A constructor like Maze_newFilled that packs the walls of two rooms into each
+ * byte. Packed mazes behave just like any other maze, but take a quarter of the
+ * memory: half a byte of walls per room, plus a byte of markers per room that is
+ * only committed once rooms are actually marked. Because neighbouring rooms
+ * share bytes, two threads must not tunnel next to each other at once.
+ *
+ * \param x The height of the maze.
+ * \param y The width of the maze.
+ *
+ * \return A new packed maze with x height and y width, with rooms that have
+ *     all four walls.
+ */
+Maze Maze_newPacked(int x, int y);
+
+/**
+ * Resizes a maze and puts every wall of every room back up, clearing every
+ * marker, as though it had just been made by Maze_newFilled or Maze_newPacked
+ * (whichever made it). The memory of the maze is reused, and only grown if the
+ * new maze has more rooms than the old one, so that a maze refilled over and
+ * over costs no allocations. A maze imported from a binary file stops being
+ * mapped from it.
+ *
+ * \param this The maze to refill.
+ * \param x The new height of the maze.
+ * \param y The new width of the maze.
+ *
+ * \return true if the maze was refilled, false if there was not enough memory,
+ *     in which case the maze is left empty.
+ */
+bool Maze_refill(Maze this, int x, int y);
+
 /**
  * Breaks the wall between two rooms. If the rooms are not adjacent or there is
  * no wall between them, this function returns false.
@@ -229,13 +618,48 @@ Maze Maze_newFilled(int x, int y);
 bool Maze_tunnel(Maze this, Room from, Room to);
 
 /**
- * Gets a random room in the maze.
+ * Breaks the wall between the rooms at two offsets, as Maze_tunnel does.
+ *
+ * \param this The maze to operate on.
+ * \param from The offset of one room, which must be in range.
+ * \param to The offset of the other room, which must be in range.
+ *
+ * \return true if a wall was broken between the rooms, false if not.
+ */
+bool Maze_tunnelAt(Maze this, int from, int to);
+
+/**
+ * Builds a wall between two rooms, undoing Maze_tunnel. If the rooms are not
+ * adjacent, this function returns false.
+ *
+ * \param this The maze to operate on.
+ * \param from The room to check.
+ * \param to The other room to check.
+ *
+ * \return true if there is now a wall between the rooms, false if not.
+ */
+bool Maze_addWall(Maze this, Room from, Room to);
+
+/**
+ * Builds a wall between the rooms at two offsets, as Maze_addWall does.
+ *
+ * \param this The maze to operate on.
+ * \param from The offset of one room, which must be in range.
+ * \param to The offset of the other room, which must be in range.
+ *
+ * \return true if there is now a wall between the rooms, false if not.
+ */
+bool Maze_addWallAt(Maze this, int from, int to);
+
+/**
+ * Gets a random room in the maze, every room being equally likely.
  *
  * \param this The maze to operate on.
+ * \param rng The random number generator to draw the room from.
  *
  * \return A random room from the maze.
  */
-Room Maze_getRandomRoom(Maze this);
+Room Maze_getRandomRoom(Maze this, struct rng *rng);
 
 /**
  * Sets the start room of the maze. Note that the easiest way to set the start
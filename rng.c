@@ -0,0 +1,82 @@
+#include <stdint.h>
+
+#include "rng.h"
+
+#define HIGH(X) ((uint64_t)(X) << 32)
+#define rotate(X, K) (((X) << (K)) | ((X) >> (32 - (K))))
+
+void seedState(struct rng *this, uint64_t seed);
+
+void Rng_seed(struct rng *this, unsigned long seed)
+{
+    seedState(this, seed);
+}
+
+void Rng_split(struct rng *this, struct rng *child)
+{
+    uint32_t high;
+
+    high = Rng_next(this);
+    seedState(child, HIGH(high) | Rng_next(this));
+}
+
+/**
+ * Fills the state of a generator from a SplitMix64 sequence started at the
+ * seed, as the authors of xoshiro suggest, so that seeds differing in a single
+ * bit still give unrelated states, and the state is never all zero.
+ */
+void seedState(struct rng *this, uint64_t seed)
+{
+    int i;
+    uint64_t mixed;
+
+    for (i = 0; i < 4; i += 2)
+    {
+        seed += HIGH(0x9e3779b9) | 0x7f4a7c15;
+        mixed = seed;
+        mixed = (mixed ^ (mixed >> 30)) * (HIGH(0xbf58476d) | 0x1ce4e5b9);
+        mixed = (mixed ^ (mixed >> 27)) * (HIGH(0x94d049bb) | 0x133111eb);
+        mixed ^= mixed >> 31;
+        this->state[i] = (uint32_t)mixed;
+        this->state[i + 1] = (uint32_t)(mixed >> 32);
+    }
+}
+
+uint32_t Rng_next(struct rng *this)
+{
+    uint32_t result, shifted, *s;
+
+    s = this->state;
+    result = s[1] * 5;
+    result = rotate(result, 7) * 9;
+    shifted = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= shifted;
+    s[3] = rotate(s[3], 11);
+    return result;
+}
+
+/**
+ * Lemire's method: the high half of a 32 by 32 bit product of a random number
+ * and the bound is below the bound, and is unbiased once the few products whose
+ * low half falls below 2^32 mod bound are drawn again. That remainder is only
+ * worked out, with a division, in the rare case that it might matter.
+ */
+int Rng_below(struct rng *this, int bound)
+{
+    uint32_t limit, threshold;
+    uint64_t product;
+
+    limit = bound;
+    product = (uint64_t)Rng_next(this) * limit;
+    if ((uint32_t)product < limit)
+    {
+        threshold = (0 - limit) % limit;
+        while ((uint32_t)product < threshold)
+            product = (uint64_t)Rng_next(this) * limit;
+    }
+    return (int)(product >> 32);
+}
@@ -0,0 +1,63 @@
+/**
+ * \file rng.h
+ *
+ * A small, fast pseudorandom number generator, xoshiro128**, whose whole state
+ * is held by its caller. Unlike rand, every generator is independent of every
+ * other, so each thread can own one and the numbers drawn from a given seed are
+ * the same on every platform.
+ */
+
+#ifndef RNG_HEADER
+#define RNG_HEADER
+
+#include <stdint.h>
+
+/**
+ * The state of a generator. It must be seeded with Rng_seed or Rng_split before
+ * it is used.
+ */
+struct rng
+{
+    uint32_t state[4];
+};
+
+/**
+ * Seeds a generator. The same seed always gives the same numbers.
+ *
+ * \param this The generator to seed.
+ * \param seed The seed.
+ */
+void Rng_seed(struct rng *this, unsigned long seed);
+
+/**
+ * Seeds a new generator from the next numbers of another, so that one seed can
+ * give each of several threads a generator of its own whose numbers do not
+ * depend on how the threads are scheduled.
+ *
+ * \param this The generator to draw the seed from.
+ * \param child The generator to seed.
+ */
+void Rng_split(struct rng *this, struct rng *child);
+
+/**
+ * Draws the next number from a generator.
+ *
+ * \param this The generator to draw from.
+ *
+ * \return A number from 0 to 2^32 - 1, every one of them equally likely.
+ */
+uint32_t Rng_next(struct rng *this);
+
+/**
+ * Draws a number less than a bound from a generator. Every number from 0 up to
+ * the bound is exactly as likely as every other, which taking the remainder of
+ * a larger number does not ensure.
+ *
+ * \param this The generator to draw from.
+ * \param bound The bound, which must be positive.
+ *
+ * \return A number from 0 to bound - 1.
+ */
+int Rng_below(struct rng *this, int bound);
+
+#endif /* RNG_HEADER */
@@ -0,0 +1,1645 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "bool.h"
+#include "try.h"
+#include "maze.h"
+#include "graph.h"
+#include "solver.h"
+
+#define NORTH 1
+#define EAST  2
+#define SOUTH 4
+#define WEST  8
+
+#define MAXTHREADS 256
+#define TASKSPERTHREAD 8
+#define MAXSPLITS 4096
+#define MEMOSTART 1024
+#define HEAPSTART 1024
+#define UNREACHED INT_MAX
+#define MAXMEMO (1 << 20)
+#define HIGH(X) ((uint64_t)(X) << 32)
+
+/**
+ * A room on the stack of a depth-first search, and the index of the next of its
+ * neighbours to visit.
+ */
+struct frame
+{
+    int room, next;
+};
+
+/**
+ * One block of a maze, with its rooms numbered from 0 and the passages out of
+ * each room kept four to a room in adjacent, ending early with -1. The paths
+ * counted are those from entry to exit. The blocks found inside a block keep the
+ * number each of their rooms had in the outermost block in ids, and are known
+ * by a key hashed from those numbers and their entry and exit, so that the same
+ * block reached again by another path is only ever counted once.
+ */
+struct block
+{
+    int nrooms, entry, exit;
+    int *adjacent, *ids;
+    uint64_t key[2];
+};
+
+/**
+ * A room waiting in the heap of an A* search. Rooms with the same estimate are
+ * taken closest to the finish first, which finds the finish sooner.
+ */
+struct node
+{
+    int estimate, remaining, room;
+};
+
+#define LESS(A, B) ((A).estimate < (B).estimate || \
+    ((A).estimate == (B).estimate && (A).remaining < (B).remaining))
+
+/**
+ * The state of the searches of one thread over a view of a maze. Nothing in the
+ * view or the maze is written, so any number of searches can share them. Each
+ * search takes a new generation, and a room has only been reached in the search
+ * if its stamp is that generation (or one more), so nothing needs clearing
+ * between searches. The arrays a search does not use are not allocated until a
+ * search that does is run.
+ */
+struct search
+{
+    Graph graph;
+    int from, to, length, expanded, meet[2];
+    uint32_t generation;
+    uint32_t *stamp;
+    int *parent, *distance, *queue[2];
+    struct node *heap;
+    size_t heapsize;
+};
+
+/**
+ * The tree a maze without loops is hung as from its first room. The jump of a
+ * room is an ancestor chosen by the depth of the room alone, Myers' skew-binary
+ * scheme: the jumps of a room's parent and of that jump's own jump are merged
+ * into one if they span the same number of levels. Every room is then at most a
+ * logarithmic number of jumps and parents from any of its ancestors.
+ */
+struct treeindex
+{
+    int *parent, *jump, *depth;
+};
+
+/**
+ * The distance of every room from the finish, UNREACHED if it cannot reach it.
+ * The queue and the marks of the rooms affected by building a wall are only
+ * ever used during an update, and are kept to spare allocating them each time;
+ * the rooms affected are gathered into nodes, which grows as needed, with the
+ * distance each is first given in estimate.
+ */
+struct distancefield
+{
+    Maze maze;
+    int finish, nrooms;
+    int *distance, *queue;
+    char *affected;
+    struct node *nodes;
+    size_t nodesize;
+};
+
+/**
+ * The rooms the blocks are found in: either the view of a whole maze, or a
+ * block less the rooms marked in removed.
+ */
+struct graph
+{
+    Graph view;
+    struct block *block;
+    char *removed;
+};
+
+/**
+ * A count too large for any integer type, kept as limbs of 32 bits each with
+ * the least significant first.
+ */
+struct bignum
+{
+    int nlimbs, size;
+    uint32_t *limbs;
+};
+
+/**
+ * The blocks counted so far by one thread, in a hash table of their keys. The
+ * table stops growing at MAXMEMO blocks.
+ */
+struct memo
+{
+    int size, count;
+    struct entry
+    {
+        uint64_t key[2];
+        struct bignum paths;
+    } *entries;
+};
+
+/**
+ * A part of the paths across a block: all those that start with the rooms in
+ * prefix.
+ */
+struct task
+{
+    int length;
+    int *prefix;
+};
+
+/**
+ * The state shared by the threads counting the paths across one block. The
+ * threads take their tasks in turn and add the paths they find to paths.
+ */
+struct counter
+{
+    struct block *block;
+    struct task *tasks;
+    int ntasks, next, done, nparts;
+    struct bignum paths;
+    bool counted, progress, reported;
+    int index, nblocks;
+    pthread_mutex_t lock;
+};
+
+int markPath(Maze maze, int algorithm, Room room, int *expanded);
+void searchBreadthFirst(struct search *this);
+void searchAStar(struct search *this);
+void searchBidirectional(struct search *this);
+int findAncestor(struct treeindex *this, int room, int depth);
+int findCommonAncestor(struct treeindex *this, int first, int second);
+int getEntrances(Maze maze, int room, int *entrances);
+int lowerDistances(struct distancefield *this, int room);
+int raiseDistances(struct distancefield *this, int room);
+bool findAffected(struct distancefield *this, int room, int *naffected);
+int compareNodes(const void *first, const void *second);
+int getNeighbours(struct graph *this, int room, int *adjacent);
+bool findBlocks(struct graph *graph, int nrooms, int from, int to, int **blocks, int *nblocks);
+bool buildBlock(struct graph *graph, int *head, int *local, int *members, int block, int entry, int exit, struct block *this);
+void freeBlock(struct block *this);
+uint64_t hashRoom(uint64_t id);
+bool countBetween(struct graph *graph, int nrooms, int from, int to, struct memo *memo, struct bignum *paths);
+bool countAcross(struct block *block, struct memo *memo, struct bignum *paths);
+struct entry *findMemo(struct memo *this, uint64_t *key);
+bool addMemo(struct memo *this, uint64_t *key, struct bignum *paths);
+void freeMemo(struct memo *this);
+bool countBlock(struct counter *this, int threads);
+bool splitTasks(struct counter *this, int ntasks);
+void *countThread(void *counter);
+bool setBignum(struct bignum *this, uint32_t value);
+bool growBignum(struct bignum *this, int size);
+bool addBignum(struct bignum *this, struct bignum *other);
+bool multiplyBignum(struct bignum *this, struct bignum *other);
+char *formatBignum(struct bignum *this);
+
+int Solver_shortestPath(Maze maze, Room room, int *visited)
+{
+    return markPath(maze, Solver_bfs, room, visited);
+}
+
+int Solver_aStar(Maze maze, Room room, int *expanded)
+{
+    return markPath(maze, Solver_astar, room, expanded);
+}
+
+int Solver_bidirectional(Maze maze, Room room, int *expanded)
+{
+    return markPath(maze, Solver_bibfs, room, expanded);
+}
+
+int Solver_findPath(Maze maze, int algorithm, int *expanded)
+{
+    return markPath(maze, algorithm, Maze_getStart(maze), expanded);
+}
+
+/**
+ * Finds a path with a search of its own over a view of the maze, and marks every
+ * room of it but the finish as visited.
+ */
+int markPath(Maze maze, int algorithm, Room room, int *expanded)
+{
+    int i, n, length;
+    int *path;
+    Graph graph;
+    Search search;
+
+    length = -1;
+    path = NULL;
+    search = NULL;
+    if (expanded) *expanded = 0;
+    TRY( (graph = Graph_new(maze)) );
+    TRY( (search = Search_new(graph)) );
+    length = Search_findPath(search, algorithm, Maze_getOffset(maze, room),
+        Maze_getOffset(maze, Maze_getFinish(maze)), expanded);
+    if (length < 0) goto FINALLY;
+    if (!(path = malloc(sizeof *path * (length + 1)))) length = -1;
+    n = path ? Search_getPath(search, path) : 0;
+    for (i = 0; i < n - 1; i++) Maze_setMarkerAt(maze, path[i], Room_visited);
+
+FINALLY:
+    free(path);
+    Search_free(&search);
+    Graph_free(&graph);
+    return length;
+}
+
+Search Search_new(Graph graph)
+{
+    bool created;
+    Search this;
+
+    created = false;
+    TRY( (this = malloc(sizeof *this)) );
+    this->graph = graph;
+    this->generation = 0;
+    this->length = -1;
+    this->expanded = 0;
+    this->parent = this->distance = this->queue[0] = this->queue[1] = NULL;
+    this->heap = NULL;
+    this->heapsize = 0;
+    TRY( (this->stamp = calloc(graph->nrooms + 1, sizeof *this->stamp)) );
+    TRY( (this->parent = malloc(sizeof *this->parent * (graph->nrooms + 1))) );
+    TRY( (this->queue[0] = malloc(sizeof *this->queue[0] * (graph->nrooms + 1))) );
+    created = true;
+
+FINALLY:
+    if (!created) Search_free(&this);
+    return this;
+}
+
+void Search_free(Search *this)
+{
+    if (*this)
+    {
+        free((*this)->stamp);
+        free((*this)->parent);
+        free((*this)->distance);
+        free((*this)->queue[0]);
+        free((*this)->queue[1]);
+        free((*this)->heap);
+    }
+    free(*this);
+    *this = NULL;
+}
+
+int Search_findPath(Search this, int algorithm, int from, int to, int *expanded)
+{
+    int nrooms;
+
+    this->length = -1;
+    this->expanded = 0;
+    this->from = from;
+    this->to = to;
+    this->meet[0] = this->meet[1] = to;
+    nrooms = this->graph->nrooms + 1;
+    if (algorithm != Solver_bfs && !this->distance)
+        TRY( (this->distance = malloc(sizeof *this->distance * nrooms)) );
+    if (algorithm == Solver_bibfs && !this->queue[1])
+        TRY( (this->queue[1] = malloc(sizeof *this->queue[1] * nrooms)) );
+    if (algorithm == Solver_astar && !this->heap)
+    {
+        TRY( (this->heap = malloc(sizeof *this->heap * HEAPSTART)) );
+        this->heapsize = HEAPSTART;
+    }
+
+    /* every search takes two stamps; the oldest are only cleared once they run out */
+    if (this->generation >= 0xFFFFFFFFu - 2)
+    {
+        memset(this->stamp, 0, sizeof *this->stamp * nrooms);
+        this->generation = 0;
+    }
+    this->generation += 2;
+    if (algorithm == Solver_astar) searchAStar(this);
+    else if (algorithm == Solver_bibfs) searchBidirectional(this);
+    else searchBreadthFirst(this);
+
+FINALLY:
+    if (expanded) *expanded = this->expanded;
+    return this->length;
+}
+
+int Search_getPath(Search this, int *path)
+{
+    int i, n, room, temp;
+
+    n = 0;
+    if (this->length < 0) return 0;
+    for (room = this->meet[0]; ; room = this->parent[room])
+    {
+        path[n++] = room;
+        if (room == this->parent[room]) break;
+    }
+    for (i = 0; i < n / 2; i++)
+    {
+        temp = path[i];
+        path[i] = path[n - 1 - i];
+        path[n - 1 - i] = temp;
+    }
+    if (this->meet[1] != this->meet[0])
+        for (room = this->meet[1]; ; room = this->parent[room])
+        {
+            path[n++] = room;
+            if (room == this->parent[room]) break;
+        }
+    return n;
+}
+
+/**
+ * A breadth-first search. A room has been reached in this search if its stamp
+ * is the generation of the search.
+ */
+void searchBreadthFirst(struct search *this)
+{
+    int i, count, head, tail, current, next;
+    int *parent, *queue, *offsets;
+    uint32_t reached, *stamp;
+    Graph graph;
+
+    graph = this->graph;
+    parent = this->parent;
+    queue = this->queue[0];
+    stamp = this->stamp;
+    reached = this->generation;
+    head = tail = 0;
+    current = this->from;
+    stamp[current] = reached;
+    parent[current] = current;
+    queue[tail++] = current;
+    while (head < tail && (current = queue[head++]) != this->to)
+    {
+        count = graph->counts[graph->passages[current]];
+        offsets = graph->offsets[graph->passages[current]];
+        for (i = 0; i < count; i++)
+        {
+            next = current + offsets[i];
+            if (stamp[next] == reached) continue;
+            stamp[next] = reached;
+            parent[next] = current;
+            queue[tail++] = next;
+        }
+    }
+    this->expanded = head;
+    if (stamp[this->to] != reached) return;
+    for (this->length = 0, current = this->to; current != parent[current]; this->length++)
+        current = parent[current];
+}
+
+/**
+ * An A* search, always expanding next the room whose distance from the start
+ * plus its Manhattan distance to the finish is least. A room has been reached
+ * in this search if its stamp is at least the generation of the search, and
+ * expanded if it is one more.
+ */
+void searchAStar(struct search *this)
+{
+    int i, npassages, width, fx, fy, current, next;
+    int *parent, *distance, *offsets;
+    size_t nheap, hole, child;
+    uint32_t reached, closed, *stamp;
+    struct node *heap, *larger, node;
+    Graph graph;
+
+    graph = this->graph;
+    parent = this->parent;
+    distance = this->distance;
+    stamp = this->stamp;
+    heap = this->heap;
+    reached = this->generation;
+    closed = reached + 1;
+    width = graph->width;
+    fx = this->to / width;
+    fy = this->to % width;
+
+    current = this->from;
+    stamp[current] = reached;
+    parent[current] = current;
+    distance[current] = 0;
+    heap[0].room = current;
+    heap[0].remaining = heap[0].estimate = abs(current / width - fx) + abs(current % width - fy);
+    nheap = 1;
+    while (nheap > 0)
+    {
+        /* pop the least estimate, sifting the last node down from the root */
+        current = heap[0].room;
+        node = heap[--nheap];
+        for (hole = 0; (child = 2 * hole + 1) < nheap; hole = child)
+        {
+            if (child + 1 < nheap && LESS(heap[child + 1], heap[child])) child++;
+            if (!LESS(heap[child], node)) break;
+            heap[hole] = heap[child];
+        }
+        heap[hole] = node;
+
+        if (stamp[current] == closed) continue;
+        stamp[current] = closed;
+        this->expanded++;
+        if (current == this->to) break;
+        npassages = graph->counts[graph->passages[current]];
+        offsets = graph->offsets[graph->passages[current]];
+        for (i = 0; i < npassages; i++)
+        {
+            next = current + offsets[i];
+            if (stamp[next] == closed || (stamp[next] == reached && distance[next] <= distance[current] + 1))
+                continue;
+            stamp[next] = reached;
+            parent[next] = current;
+            distance[next] = distance[current] + 1;
+            if (nheap == this->heapsize)
+            {
+                TRY( (larger = realloc(heap, sizeof *heap * this->heapsize * 2)) );
+                this->heap = heap = larger;
+                this->heapsize *= 2;
+            }
+            node.room = next;
+            node.remaining = abs(next / width - fx) + abs(next % width - fy);
+            node.estimate = distance[next] + node.remaining;
+            for (hole = nheap++; hole > 0 && LESS(node, heap[(hole - 1) / 2]); hole = (hole - 1) / 2)
+                heap[hole] = heap[(hole - 1) / 2];
+            heap[hole] = node;
+        }
+    }
+    if (stamp[this->to] == closed) this->length = distance[this->to];
+
+FINALLY:
+    return;
+}
+
+/**
+ * Two breadth-first searches, one from each end, taking a whole level of
+ * whichever has the smaller frontier in turn until they meet. A room has been
+ * reached from the start in this search if its stamp is the generation of the
+ * search, and from the finish if it is one more.
+ */
+void searchBidirectional(struct search *this)
+{
+    int i, npassages, side, other, current, next, end, best;
+    int *parent, *distance, *queue[2], head[2], tail[2], *offsets;
+    uint32_t reached, *stamp;
+    Graph graph;
+
+    graph = this->graph;
+    parent = this->parent;
+    distance = this->distance;
+    queue[0] = this->queue[0];
+    queue[1] = this->queue[1];
+    stamp = this->stamp;
+    reached = this->generation;
+    for (side = 0; side < 2; side++)
+    {
+        current = side == 0 ? this->from : this->to;
+        if (stamp[current] >= reached) break;
+        stamp[current] = reached + side;
+        parent[current] = current;
+        distance[current] = 0;
+        queue[side][0] = current;
+        head[side] = 0;
+        tail[side] = 1;
+    }
+    best = side < 2 ? 0 : -1;
+    this->meet[0] = this->meet[1] = current;
+    while (best < 0 && head[0] < tail[0] && head[1] < tail[1])
+    {
+        side = tail[0] - head[0] <= tail[1] - head[1] ? 0 : 1;
+        other = 1 - side;
+        for (end = tail[side]; head[side] < end; )
+        {
+            current = queue[side][head[side]++];
+            this->expanded++;
+            npassages = graph->counts[graph->passages[current]];
+            offsets = graph->offsets[graph->passages[current]];
+            for (i = 0; i < npassages; i++)
+            {
+                next = current + offsets[i];
+                if (stamp[next] == reached + other)
+                {
+                    if (best < 0 || distance[current] + 1 + distance[next] < best)
+                    {
+                        best = distance[current] + 1 + distance[next];
+                        this->meet[side] = current;
+                        this->meet[other] = next;
+                    }
+                    continue;
+                }
+                if (stamp[next] >= reached) continue;
+                stamp[next] = reached + side;
+                parent[next] = current;
+                distance[next] = distance[current] + 1;
+                queue[side][tail[side]++] = next;
+            }
+        }
+    }
+    this->length = best;
+}
+
+TreeIndex TreeIndex_new(Graph graph)
+{
+    bool built;
+    int i, nrooms, npassages, head, tail, current, next, up;
+    int *queue, *offsets, *parent, *jump, *depth;
+    TreeIndex this;
+
+    built = false;
+    queue = NULL;
+    nrooms = graph->nrooms;
+    for (i = npassages = 0; i < nrooms; i++) npassages += graph->counts[graph->passages[i]];
+    /* a maze with loops is not an error, so it is turned away before allocating */
+    if (nrooms == 0 || npassages != 2 * (nrooms - 1)) return NULL;
+    TRY( (this = malloc(sizeof *this)) );
+    this->parent = this->jump = this->depth = NULL;
+    TRY( (parent = this->parent = malloc(sizeof *parent * nrooms)) );
+    TRY( (jump = this->jump = malloc(sizeof *jump * nrooms)) );
+    TRY( (depth = this->depth = malloc(sizeof *depth * nrooms)) );
+    TRY( (queue = malloc(sizeof *queue * nrooms)) );
+    for (i = 0; i < nrooms; i++) parent[i] = -1;
+    parent[0] = jump[0] = 0;
+    depth[0] = 0;
+    queue[0] = 0;
+    for (head = 0, tail = 1; head < tail; )
+    {
+        current = queue[head++];
+        up = jump[current];
+        offsets = graph->offsets[graph->passages[current]];
+        for (i = 0; i < graph->counts[graph->passages[current]]; i++)
+        {
+            next = current + offsets[i];
+            if (parent[next] >= 0) continue;
+            parent[next] = current;
+            depth[next] = depth[current] + 1;
+            jump[next] = depth[current] - depth[up] == depth[up] - depth[jump[up]] ? jump[up] : current;
+            queue[tail++] = next;
+        }
+    }
+    TRY(tail == nrooms);
+    built = true;
+
+FINALLY:
+    free(queue);
+    if (!built) TreeIndex_free(&this);
+    return this;
+}
+
+void TreeIndex_free(TreeIndex *this)
+{
+    if (*this)
+    {
+        free((*this)->parent);
+        free((*this)->jump);
+        free((*this)->depth);
+    }
+    free(*this);
+    *this = NULL;
+}
+
+int TreeIndex_getDistance(TreeIndex this, int from, int to)
+{
+    return this->depth[from] + this->depth[to] - 2 * this->depth[findCommonAncestor(this, from, to)];
+}
+
+int TreeIndex_getPath(TreeIndex this, int from, int to, int *path)
+{
+    int i, n, room, common;
+
+    common = findCommonAncestor(this, from, to);
+    n = this->depth[from] + this->depth[to] - 2 * this->depth[common] + 1;
+    for (i = 0, room = from; room != common; room = this->parent[room]) path[i++] = room;
+    path[i] = common;
+    for (i = n - 1, room = to; room != common; room = this->parent[room]) path[i--] = room;
+    return n;
+}
+
+/**
+ * Finds the ancestor of a room at a given depth, taking a room's jump whenever
+ * it does not overshoot.
+ */
+int findAncestor(struct treeindex *this, int room, int depth)
+{
+    while (this->depth[room] > depth)
+        room = this->depth[this->jump[room]] >= depth ? this->jump[room] : this->parent[room];
+    return room;
+}
+
+/**
+ * Finds the lowest common ancestor of two rooms. Once they are at the same
+ * depth their jumps are too, so both take their jumps while those still differ
+ * and their parents otherwise.
+ */
+int findCommonAncestor(struct treeindex *this, int first, int second)
+{
+    if (this->depth[first] > this->depth[second]) first = findAncestor(this, first, this->depth[second]);
+    else second = findAncestor(this, second, this->depth[first]);
+    while (first != second)
+    {
+        if (this->jump[first] != this->jump[second])
+        {
+            first = this->jump[first];
+            second = this->jump[second];
+        }
+        else
+        {
+            first = this->parent[first];
+            second = this->parent[second];
+        }
+    }
+    return first;
+}
+
+DistanceField DistanceField_new(Maze maze)
+{
+    bool built;
+    int i, head, tail, current, count, adjacent[4];
+    int *distance;
+    DistanceField this;
+
+    built = false;
+    TRY( (this = malloc(sizeof *this)) );
+    this->maze = maze;
+    this->finish = Maze_getOffset(maze, Maze_getFinish(maze));
+    this->nrooms = Maze_getRoomCount(maze);
+    this->queue = NULL;
+    this->affected = NULL;
+    this->nodes = NULL;
+    this->nodesize = 0;
+    TRY( (distance = this->distance = malloc(sizeof *distance * this->nrooms)) );
+    TRY( (this->queue = malloc(sizeof *this->queue * this->nrooms)) );
+    TRY( (this->affected = calloc(this->nrooms, 1)) );
+    for (i = 0; i < this->nrooms; i++) distance[i] = UNREACHED;
+    distance[this->finish] = 0;
+    this->queue[0] = this->finish;
+    for (head = 0, tail = 1; head < tail; )
+    {
+        current = this->queue[head++];
+        count = getEntrances(maze, current, adjacent);
+        for (i = 0; i < count; i++)
+            if (distance[adjacent[i]] == UNREACHED)
+            {
+                distance[adjacent[i]] = distance[current] + 1;
+                this->queue[tail++] = adjacent[i];
+            }
+    }
+    built = true;
+
+FINALLY:
+    if (!built) DistanceField_free(&this);
+    return this;
+}
+
+void DistanceField_free(DistanceField *this)
+{
+    if (*this)
+    {
+        free((*this)->distance);
+        free((*this)->queue);
+        free((*this)->affected);
+        free((*this)->nodes);
+    }
+    free(*this);
+    *this = NULL;
+}
+
+int DistanceField_update(DistanceField this, int from, int to)
+{
+    int i, count, swap, adjacent[4];
+    int *distance;
+
+    distance = this->distance;
+    if (distance[from] > distance[to])
+    {
+        swap = from; from = to; to = swap;
+    }
+    if (distance[from] == UNREACHED) return 0;
+    count = getEntrances(this->maze, from, adjacent);
+    for (i = 0; i < count && adjacent[i] != to; i++) ;
+    if (i < count)
+    {
+        if (distance[from] + 1 >= distance[to]) return 0;
+        distance[to] = distance[from] + 1;
+        return lowerDistances(this, to);
+    }
+    if (distance[to] != distance[from] + 1) return 0;
+    count = Maze_getAdjacentAt(this->maze, to, adjacent, false);
+    for (i = 0; i < count; i++)
+        if (distance[adjacent[i]] == distance[to] - 1) return 0;
+    return raiseDistances(this, to);
+}
+
+int DistanceField_getDistance(DistanceField this, int room)
+{
+    return this->distance[room] == UNREACHED ? -1 : this->distance[room];
+}
+
+int DistanceField_getPath(DistanceField this, int room, int *path)
+{
+    int i, n, count, adjacent[4];
+
+    if (this->distance[room] == UNREACHED) return 0;
+    n = 0;
+    path[n++] = room;
+    while (room != this->finish)
+    {
+        count = Maze_getAdjacentAt(this->maze, room, adjacent, false);
+        for (i = 0; i < count && this->distance[adjacent[i]] != this->distance[room] - 1; i++) ;
+        /* only if the walls were changed without the field being told */
+        if (i == count) return 0;
+        path[n++] = room = adjacent[i];
+    }
+    return n;
+}
+
+/**
+ * Finds the rooms next to a room that can step into it, those whose own wall
+ * facing it is down. This is Maze_getAdjacentAt turned around, and differs from
+ * it only where a wall stands on one side alone; the distances are spread along
+ * it so that they follow the passages the way a path from a room walks them.
+ *
+ * \return The number of rooms put in entrances.
+ */
+int getEntrances(Maze maze, int room, int *entrances)
+{
+    int width, count;
+
+    width = Maze_getWidth(maze);
+    count = 0;
+    if (room >= width && !(Maze_getWallsAt(maze, room - width) & SOUTH))
+        entrances[count++] = room - width;
+    if (room % width < width - 1 && !(Maze_getWallsAt(maze, room + 1) & WEST))
+        entrances[count++] = room + 1;
+    if (room < Maze_getRoomCount(maze) - width && !(Maze_getWallsAt(maze, room + width) & NORTH))
+        entrances[count++] = room + width;
+    if (room % width > 0 && !(Maze_getWallsAt(maze, room - 1) & EAST))
+        entrances[count++] = room - 1;
+    return count;
+}
+
+/**
+ * Spreads the distance of a room that has just been lowered to the rooms around
+ * it, breadth first.
+ *
+ * \return The number of rooms lowered, the room itself included.
+ */
+int lowerDistances(struct distancefield *this, int room)
+{
+    int i, head, tail, current, count, adjacent[4];
+    int *distance;
+
+    distance = this->distance;
+    this->queue[0] = room;
+    for (head = 0, tail = 1; head < tail; )
+    {
+        current = this->queue[head++];
+        count = getEntrances(this->maze, current, adjacent);
+        for (i = 0; i < count; i++)
+            if (distance[current] + 1 < distance[adjacent[i]])
+            {
+                distance[adjacent[i]] = distance[current] + 1;
+                this->queue[tail++] = adjacent[i];
+            }
+    }
+    return tail;
+}
+
+/**
+ * Works out again the distances of the rooms that reached the finish only
+ * through a room that has just lost its last way one step closer. Those rooms
+ * are found first, and each is given the distance it would have through the
+ * rooms around it that were not affected; the rooms are then taken in order of
+ * those distances, merged with a queue of the rooms lowered from them, as a
+ * breadth-first search started from all of them at once would take them.
+ *
+ * \return The number of rooms whose distance changed, or -1 if there was not
+ *     enough memory.
+ */
+int raiseDistances(struct distancefield *this, int room)
+{
+    int i, j, n, naffected, nseeds, head, tail, current, count, adjacent[4];
+    int *distance;
+    struct node *nodes;
+
+    distance = this->distance;
+    if (!findAffected(this, room, &naffected)) return -1;
+    nodes = this->nodes;
+    for (i = 0; i < naffected; i++) distance[nodes[i].room] = UNREACHED;
+    for (i = nseeds = 0; i < naffected; i++)
+    {
+        current = nodes[i].room;
+        count = Maze_getAdjacentAt(this->maze, current, adjacent, false);
+        for (j = 0; j < count; j++)
+            if (!this->affected[adjacent[j]] && distance[adjacent[j]] < distance[current] - 1)
+                distance[current] = distance[adjacent[j]] + 1;
+        nodes[i].estimate = distance[current];
+        if (distance[current] != UNREACHED) nseeds++;
+    }
+    qsort(nodes, naffected, sizeof *nodes, compareNodes);
+    for (n = head = tail = 0; n < nseeds || head < tail; )
+    {
+        if (head == tail || (n < nseeds && nodes[n].estimate <= distance[this->queue[head]]))
+        {
+            current = nodes[n++].room;
+            if (nodes[n - 1].estimate != distance[current]) continue;
+        }
+        else current = this->queue[head++];
+        count = getEntrances(this->maze, current, adjacent);
+        for (j = 0; j < count; j++)
+            if (this->affected[adjacent[j]] && distance[current] + 1 < distance[adjacent[j]])
+            {
+                distance[adjacent[j]] = distance[current] + 1;
+                this->queue[tail++] = adjacent[j];
+            }
+    }
+    for (i = 0; i < naffected; i++) this->affected[nodes[i].room] = false;
+    return naffected;
+}
+
+/**
+ * Gathers into the nodes of a distance field the rooms that can no longer reach
+ * the finish in as few steps as before, starting from a room that has lost its
+ * last way one step closer, and marks them as affected. A room further on is
+ * affected if every room one step closer to the finish next to it is. The rooms
+ * are taken one distance at a time, so every affected room one step closer has
+ * been marked by the time a room is looked at.
+ */
+bool findAffected(struct distancefield *this, int room, int *naffected)
+{
+    bool found, supported;
+    int i, j, n, current, next, count, nextcount, adjacent[4], around[4];
+    int *distance;
+    struct node *larger;
+
+    found = false;
+    distance = this->distance;
+    n = 0;
+    this->affected[room] = true;
+    this->queue[n++] = room;
+    for (i = 0; i < n; i++)
+    {
+        current = this->queue[i];
+        count = getEntrances(this->maze, current, adjacent);
+        for (j = 0; j < count; j++)
+        {
+            next = adjacent[j];
+            if (this->affected[next] || distance[next] != distance[current] + 1) continue;
+            nextcount = Maze_getAdjacentAt(this->maze, next, around, false);
+            for (supported = false; nextcount > 0 && !supported; nextcount--)
+                supported = !this->affected[around[nextcount - 1]]
+                    && distance[around[nextcount - 1]] == distance[next] - 1;
+            if (supported) continue;
+            this->affected[next] = true;
+            this->queue[n++] = next;
+        }
+    }
+    if ((size_t)n > this->nodesize)
+    {
+        TRY( (larger = realloc(this->nodes, sizeof *larger * n)) );
+        this->nodes = larger;
+        this->nodesize = n;
+    }
+    for (i = 0; i < n; i++) this->nodes[i].room = this->queue[i];
+    *naffected = n;
+    found = true;
+
+FINALLY:
+    if (!found) for (i = 0; i < n; i++) this->affected[this->queue[i]] = false;
+    return found;
+}
+
+int compareNodes(const void *first, const void *second)
+{
+    const struct node *a, *b;
+
+    a = first;
+    b = second;
+    return (a->estimate > b->estimate) - (a->estimate < b->estimate);
+}
+
+int Solver_prune(Maze maze)
+{
+    int i, nblocks, nrooms, from, pruned;
+    int *blocks, *head;
+    char *kept;
+    struct graph graph;
+
+    pruned = -1;
+    blocks = NULL;
+    kept = NULL;
+    graph.view = NULL;
+    TRY(maze && Maze_getStart(maze) && Maze_getFinish(maze));
+    TRY( (graph.view = Graph_new(maze)) );
+    graph.block = NULL;
+    graph.removed = NULL;
+    nrooms = Maze_getRoomCount(maze);
+    from = Maze_getOffset(maze, Maze_getStart(maze));
+    TRY(findBlocks(&graph, nrooms, from, Maze_getOffset(maze, Maze_getFinish(maze)), &blocks, &nblocks));
+    TRY( (kept = calloc(nrooms, 1)) );
+
+    /* the entry of every block is the start or in the block after it */
+    head = blocks + 3 * (nblocks > 0 ? nblocks : 0);
+    for (i = 0; i < nblocks; i++) kept[blocks[3 * i]] = 1;
+    pruned = 0;
+    for (i = 0; i < nrooms; i++)
+    {
+        if (i == from || (head[i] >= 0 && kept[head[i]])) continue;
+        Maze_setMarkerAt(maze, i, Room_deadend);
+        pruned++;
+    }
+
+FINALLY:
+    Graph_free(&graph.view);
+    free(blocks);
+    free(kept);
+    return pruned;
+}
+
+char *Solver_countPaths(Maze maze, int threads, bool progress)
+{
+    bool locked;
+    int i, nblocks, nrooms;
+    int *blocks, *head, *local, *members;
+    char *count;
+    struct graph graph;
+    struct block block;
+    struct counter counter;
+    struct bignum product;
+
+    count = NULL;
+    locked = false;
+    blocks = local = members = NULL;
+    block.adjacent = block.ids = NULL;
+    product.limbs = counter.paths.limbs = NULL;
+    graph.view = NULL;
+    TRY(maze && Maze_getStart(maze) && Maze_getFinish(maze));
+    TRY( (graph.view = Graph_new(maze)) );
+    graph.block = NULL;
+    graph.removed = NULL;
+    nrooms = Maze_getRoomCount(maze);
+    TRY(setBignum(&product, 1));
+    TRY(findBlocks(&graph, nrooms, Maze_getOffset(maze, Maze_getStart(maze)),
+        Maze_getOffset(maze, Maze_getFinish(maze)), &blocks, &nblocks));
+    if (nblocks < 0) product.limbs[0] = 0;
+
+    head = blocks + 3 * (nblocks > 0 ? nblocks : 0);
+    TRY( (local = malloc(sizeof *local * nrooms)) );
+    TRY( (members = malloc(sizeof *members * nrooms)) );
+    for (i = 0; i < nrooms; i++) local[i] = -1;
+    TRY( (locked = pthread_mutex_init(&counter.lock, NULL) == 0) );
+    counter.progress = progress;
+    counter.reported = false;
+    counter.nblocks = nblocks;
+    for (i = 0; i < nblocks; i++)
+    {
+        TRY(buildBlock(&graph, head, local, members, blocks[3 * i], blocks[3 * i + 1], blocks[3 * i + 2], &block));
+        if (block.nrooms > 2)
+        {
+            counter.block = &block;
+            counter.index = i + 1;
+            TRY(countBlock(&counter, threads));
+            TRY(multiplyBignum(&product, &counter.paths));
+        }
+        freeBlock(&block);
+    }
+    count = formatBignum(&product);
+
+FINALLY:
+    if (locked) pthread_mutex_destroy(&counter.lock);
+    if (locked && counter.reported) fputc('\n', stderr);
+    Graph_free(&graph.view);
+    free(blocks);
+    free(local);
+    free(members);
+    freeBlock(&block);
+    free(product.limbs);
+    free(counter.paths.limbs);
+    return count;
+}
+
+/**
+ * Gets the offsets of the rooms a room has passages to.
+ */
+int getNeighbours(struct graph *this, int room, int *adjacent)
+{
+    int i, n, mask, next;
+
+    n = 0;
+    if (this->view)
+    {
+        mask = this->view->passages[room];
+        for (n = 0; n < this->view->counts[mask]; n++) adjacent[n] = room + this->view->offsets[mask][n];
+    }
+    else
+        for (i = 0; i < 4 && (next = this->block->adjacent[4 * room + i]) >= 0; i++)
+            if (!this->removed[next]) adjacent[n++] = next;
+    return n;
+}
+
+/**
+ * Finds the blocks between two rooms with Tarjan's depth-first search from the
+ * first. Every room but the first belongs to the block of the nearest room
+ * above it in the search tree, itself included, whose subtree has no passage
+ * reaching above its parent; that room heads the block, and its parent is the
+ * room every path enters the block by. Walking up the tree from the second room
+ * then passes through exactly the blocks every path between them crosses. The
+ * blocks are returned as triples of head, entry and exit room, followed by the
+ * head of the block of every room, -1 for rooms not reached. If the second room
+ * cannot be reached, nblocks is set to -1.
+ */
+bool findBlocks(struct graph *graph, int nrooms, int from, int to, int **blocks, int *nblocks)
+{
+    bool found;
+    int i, room, next, time, depth, norder, count;
+    int adjacent[4];
+    int *discovered, *low, *parent, *order, *head;
+    struct frame *stack;
+
+    found = false;
+    *blocks = NULL;
+    discovered = low = parent = order = NULL;
+    stack = NULL;
+    TRY( (discovered = calloc(nrooms, sizeof *discovered)) );
+    TRY( (low = malloc(sizeof *low * nrooms)) );
+    TRY( (parent = malloc(sizeof *parent * nrooms)) );
+    TRY( (order = malloc(sizeof *order * nrooms)) );
+    TRY( (stack = malloc(sizeof *stack * nrooms)) );
+
+    time = norder = depth = 0;
+    discovered[from] = low[from] = ++time;
+    parent[from] = from;
+    order[norder++] = from;
+    stack[0].room = from;
+    stack[0].next = 0;
+    while (depth >= 0)
+    {
+        room = stack[depth].room;
+        if (stack[depth].next < getNeighbours(graph, room, adjacent))
+        {
+            next = adjacent[stack[depth].next++];
+            if (!discovered[next])
+            {
+                discovered[next] = low[next] = ++time;
+                parent[next] = room;
+                order[norder++] = next;
+                depth++;
+                stack[depth].room = next;
+                stack[depth].next = 0;
+            }
+            else if (next != parent[room] && discovered[next] < low[room])
+                low[room] = discovered[next];
+        }
+        else if (--depth >= 0 && low[room] < low[stack[depth].room])
+            low[stack[depth].room] = low[room];
+    }
+
+    /* the heads are found in preorder, so the head of a parent is always known */
+    head = low;
+    for (i = 1; i < norder; i++)
+    {
+        room = order[i];
+        head[room] = low[room] >= discovered[parent[room]] ? room : head[parent[room]];
+    }
+    for (i = 0; i < nrooms; i++) if (!discovered[i]) head[i] = -1;
+    head[from] = -1;
+
+    count = 0;
+    if (discovered[to])
+        for (room = to; room != from; room = parent[head[room]]) count++;
+    TRY( (*blocks = malloc(sizeof **blocks * (3 * count + nrooms))) );
+    *nblocks = discovered[to] ? count : -1;
+    for (i = 0, next = to, room = to; i < count; i++, room = next)
+    {
+        (*blocks)[3 * i] = head[room];
+        (*blocks)[3 * i + 1] = next = parent[head[room]];
+        (*blocks)[3 * i + 2] = room;
+    }
+    memcpy(*blocks + 3 * count, head, sizeof *head * nrooms);
+    found = true;
+
+FINALLY:
+    free(discovered);
+    free(low);
+    free(parent);
+    free(order);
+    free(stack);
+    return found;
+}
+
+/**
+ * Copies one block out of a graph, numbering its entry room 0 and the rest of
+ * its rooms in breadth-first order from its head. The passages of a block of
+ * two rooms, which can only be crossed one way, are not copied. The local array
+ * must hold -1 for every room on entry, and is left that way.
+ */
+bool buildBlock(struct graph *graph, int *head, int *local, int *members, int block, int entry, int exit, struct block *this)
+{
+    bool built;
+    int i, j, n, nadjacent, id;
+    int adjacent[4];
+
+    built = false;
+    this->adjacent = this->ids = NULL;
+    this->nrooms = 0;
+    members[this->nrooms] = entry;
+    local[entry] = this->nrooms++;
+    members[this->nrooms] = block;
+    local[block] = this->nrooms++;
+    for (i = 1; i < this->nrooms; i++)
+    {
+        nadjacent = getNeighbours(graph, members[i], adjacent);
+        for (j = 0; j < nadjacent; j++)
+        {
+            if (head[adjacent[j]] != block || local[adjacent[j]] >= 0) continue;
+            members[this->nrooms] = adjacent[j];
+            local[adjacent[j]] = this->nrooms++;
+        }
+    }
+    this->entry = local[entry];
+    this->exit = local[exit];
+    built = true;
+    if (this->nrooms == 2) goto FINALLY;
+
+    built = false;
+    TRY( (this->adjacent = malloc(sizeof *this->adjacent * 4 * this->nrooms)) );
+    for (i = 0; i < this->nrooms; i++)
+    {
+        nadjacent = getNeighbours(graph, members[i], adjacent);
+        for (j = n = 0; j < nadjacent; j++)
+            if (local[adjacent[j]] >= 0) this->adjacent[4 * i + n++] = local[adjacent[j]];
+        while (n < 4) this->adjacent[4 * i + n++] = -1;
+    }
+    if (graph->block)
+    {
+        TRY( (this->ids = malloc(sizeof *this->ids * this->nrooms)) );
+        this->key[0] = this->key[1] = 0;
+        for (i = 0; i < this->nrooms; i++)
+        {
+            id = graph->block->ids ? graph->block->ids[members[i]] : members[i];
+            this->ids[i] = id;
+            this->key[0] ^= hashRoom(HIGH(1) | id);
+            this->key[1] ^= hashRoom(HIGH(2) | id);
+        }
+        this->key[0] ^= hashRoom(HIGH(3) | this->ids[this->entry]);
+        this->key[1] ^= hashRoom(HIGH(4) | this->ids[this->exit]);
+    }
+    built = true;
+
+FINALLY:
+    for (i = 0; i < this->nrooms; i++) local[members[i]] = -1;
+    return built;
+}
+
+void freeBlock(struct block *this)
+{
+    free(this->adjacent);
+    free(this->ids);
+    this->adjacent = this->ids = NULL;
+}
+
+/**
+ * Hashes the number of a room with the finalizer of SplitMix64.
+ */
+uint64_t hashRoom(uint64_t id)
+{
+    id += HIGH(0x9e3779b9) | 0x7f4a7c15;
+    id = (id ^ (id >> 30)) * (HIGH(0xbf58476d) | 0x1ce4e5b9);
+    id = (id ^ (id >> 27)) * (HIGH(0x94d049bb) | 0x133111eb);
+    return id ^ (id >> 31);
+}
+
+/**
+ * Counts the paths between two rooms of a graph as the product of the paths
+ * across each block between them.
+ */
+bool countBetween(struct graph *graph, int nrooms, int from, int to, struct memo *memo, struct bignum *paths)
+{
+    bool counted;
+    int i, nblocks;
+    int *blocks, *local, *members;
+    struct block block;
+    struct bignum factor;
+
+    counted = false;
+    blocks = local = members = NULL;
+    block.adjacent = block.ids = NULL;
+    factor.limbs = NULL;
+    TRY(setBignum(paths, 1));
+    TRY(findBlocks(graph, nrooms, from, to, &blocks, &nblocks));
+    if (nblocks < 0) paths->limbs[0] = 0;
+    TRY( (local = malloc(sizeof *local * nrooms)) );
+    TRY( (members = malloc(sizeof *members * nrooms)) );
+    for (i = 0; i < nrooms; i++) local[i] = -1;
+    for (i = 0; i < nblocks; i++)
+    {
+        TRY(buildBlock(graph, blocks + 3 * nblocks, local, members,
+            blocks[3 * i], blocks[3 * i + 1], blocks[3 * i + 2], &block));
+        if (block.nrooms > 2)
+        {
+            TRY(countAcross(&block, memo, &factor));
+            TRY(multiplyBignum(paths, &factor));
+            free(factor.limbs);
+            factor.limbs = NULL;
+        }
+        freeBlock(&block);
+    }
+    counted = true;
+
+FINALLY:
+    free(blocks);
+    free(local);
+    free(members);
+    freeBlock(&block);
+    free(factor.limbs);
+    return counted;
+}
+
+/**
+ * Counts the paths across a block by taking each of its entry's passages in
+ * turn, and counting the paths from the room it leads to to the exit in the
+ * rest of the block. The rest of the block falls apart into smaller blocks that
+ * are counted in the same way, and the rooms in the parts of it that lead
+ * nowhere are never searched. Blocks already counted are looked up in memo.
+ */
+bool countAcross(struct block *block, struct memo *memo, struct bignum *paths)
+{
+    bool counted;
+    int i, next;
+    struct entry *entry;
+    struct graph graph;
+    struct bignum part;
+
+    counted = false;
+    graph.view = NULL;
+    graph.block = block;
+    graph.removed = NULL;
+    part.limbs = NULL;
+    TRY(setBignum(paths, 0));
+    if ( (entry = findMemo(memo, block->key)) )
+    {
+        TRY(addBignum(paths, &entry->paths));
+        counted = true;
+        goto FINALLY;
+    }
+    TRY( (graph.removed = calloc(block->nrooms, 1)) );
+    graph.removed[block->entry] = 1;
+    for (i = 0; i < 4 && (next = block->adjacent[4 * block->entry + i]) >= 0; i++)
+    {
+        free(part.limbs);
+        part.limbs = NULL;
+        if (next == block->exit) TRY(setBignum(&part, 1));
+        else TRY(countBetween(&graph, block->nrooms, next, block->exit, memo, &part));
+        TRY(addBignum(paths, &part));
+    }
+    TRY(addMemo(memo, block->key, paths));
+    counted = true;
+
+FINALLY:
+    free(graph.removed);
+    free(part.limbs);
+    return counted;
+}
+
+/**
+ * Counts the paths across a block. The paths are first split into tasks by the
+ * rooms they start with, and the threads then take the tasks in turn.
+ */
+bool countBlock(struct counter *this, int threads)
+{
+    bool counted;
+    int i, nthreads;
+    pthread_t workers[MAXTHREADS];
+
+    counted = false;
+    nthreads = 0;
+    this->tasks = NULL;
+    this->ntasks = this->next = this->done = 0;
+    this->counted = true;
+    free(this->paths.limbs);
+    TRY(setBignum(&this->paths, 0));
+    if (threads > MAXTHREADS) threads = MAXTHREADS;
+    if (threads < 1) threads = 1;
+    TRY(splitTasks(this, threads * TASKSPERTHREAD));
+    if (threads > this->ntasks - this->next) threads = this->ntasks - this->next;
+    for (nthreads = 0; nthreads < threads - 1; nthreads++)
+        TRY(pthread_create(&workers[nthreads], NULL, countThread, this) == 0);
+    countThread(this);
+    counted = true;
+
+FINALLY:
+    for (i = 0; i < nthreads; i++) pthread_join(workers[i], NULL);
+    for (i = 0; i < this->ntasks; i++) free(this->tasks[i].prefix);
+    free(this->tasks);
+    return counted && this->counted;
+}
+
+/**
+ * Splits the paths across a block into about ntasks tasks, if it can, by
+ * extending the shortest prefixes first. The prefix made of the entry alone is
+ * always split, so that every task leaves the entry behind it. Paths that reach
+ * the exit while being split are counted right away.
+ */
+bool splitTasks(struct counter *this, int ntasks)
+{
+    bool split;
+    int i, j, first, size, splits, next;
+    struct task *task, *tasks;
+    struct block *block;
+    struct bignum one;
+
+    split = false;
+    block = this->block;
+    one.limbs = NULL;
+    size = ntasks + 4;
+    TRY(setBignum(&one, 1));
+    TRY( (this->tasks = malloc(sizeof *this->tasks * size)) );
+    TRY( (this->tasks[0].prefix = malloc(sizeof *this->tasks[0].prefix)) );
+    this->tasks[0].prefix[0] = block->entry;
+    this->tasks[0].length = 1;
+    this->ntasks = 1;
+    for (first = 0, splits = 0; first == 0 ||
+        (this->ntasks - first < ntasks && first < this->ntasks && splits < MAXSPLITS); splits++)
+    {
+        task = &this->tasks[first++];
+        for (i = 0; i < 4 && (next = block->adjacent[4 * task->prefix[task->length - 1] + i]) >= 0; i++)
+        {
+            for (j = 0; j < task->length && task->prefix[j] != next; j++);
+            if (j < task->length) continue;
+            if (next == block->exit)
+            {
+                TRY(addBignum(&this->paths, &one));
+                continue;
+            }
+            if (this->ntasks == size)
+            {
+                TRY( (tasks = realloc(this->tasks, sizeof *tasks * size * 2)) );
+                task = tasks + (task - this->tasks);
+                this->tasks = tasks;
+                size *= 2;
+            }
+            TRY( (this->tasks[this->ntasks].prefix = malloc(sizeof *task->prefix * (task->length + 1))) );
+            memcpy(this->tasks[this->ntasks].prefix, task->prefix, sizeof *task->prefix * task->length);
+            this->tasks[this->ntasks].prefix[task->length] = next;
+            this->tasks[this->ntasks++].length = task->length + 1;
+        }
+        free(task->prefix);
+        task->prefix = NULL;
+    }
+    this->next = first;
+    this->nparts = this->ntasks - first;
+    split = true;
+
+FINALLY:
+    free(one.limbs);
+    return split;
+}
+
+/**
+ * Takes tasks until there are none left. The paths of a task are counted with
+ * the rooms of its prefix taken out of the block, from the last of them.
+ */
+void *countThread(void *counter)
+{
+    bool counted;
+    int i, j;
+    struct task *task;
+    struct graph graph;
+    struct bignum paths;
+    struct memo memo;
+    struct counter *this;
+
+    counted = false;
+    this = counter;
+    graph.view = NULL;
+    graph.block = this->block;
+    paths.limbs = NULL;
+    memo.size = memo.count = 0;
+    memo.entries = NULL;
+    TRY( (graph.removed = calloc(this->block->nrooms, 1)) );
+    for (;;)
+    {
+        pthread_mutex_lock(&this->lock);
+        i = this->next++;
+        pthread_mutex_unlock(&this->lock);
+        if (i >= this->ntasks) break;
+        task = &this->tasks[i];
+        for (j = 0; j < task->length - 1; j++) graph.removed[task->prefix[j]] = 1;
+        TRY(countBetween(&graph, this->block->nrooms, task->prefix[task->length - 1], this->block->exit, &memo, &paths));
+        for (j = 0; j < task->length - 1; j++) graph.removed[task->prefix[j]] = 0;
+
+        pthread_mutex_lock(&this->lock);
+        counted = addBignum(&this->paths, &paths);
+        this->done++;
+        if (this->progress)
+        {
+            fprintf(stderr, "\rblock %i of %i: %i of %i parts counted", this->index, this->nblocks,
+                this->done, this->nparts);
+            fflush(stderr);
+            this->reported = true;
+        }
+        pthread_mutex_unlock(&this->lock);
+        free(paths.limbs);
+        paths.limbs = NULL;
+        TRY(counted);
+    }
+    counted = true;
+
+FINALLY:
+    if (!counted)
+    {
+        pthread_mutex_lock(&this->lock);
+        this->counted = false;
+        this->next = this->ntasks;
+        pthread_mutex_unlock(&this->lock);
+    }
+    free(graph.removed);
+    free(paths.limbs);
+    freeMemo(&memo);
+    return NULL;
+}
+
+struct entry *findMemo(struct memo *this, uint64_t *key)
+{
+    int i;
+
+    if (this->size == 0) return NULL;
+    for (i = key[0] & (this->size - 1); this->entries[i].paths.limbs; i = (i + 1) & (this->size - 1))
+        if (this->entries[i].key[0] == key[0] && this->entries[i].key[1] == key[1])
+            return &this->entries[i];
+    return NULL;
+}
+
+/**
+ * Adds the paths across a block to a memo, doubling the size of the table
+ * whenever it becomes half full.
+ */
+bool addMemo(struct memo *this, uint64_t *key, struct bignum *paths)
+{
+    bool added;
+    int i, j;
+    struct memo larger;
+
+    added = false;
+    larger.entries = NULL;
+    if (this->count >= MAXMEMO) return true;
+    if (2 * (this->count + 1) > this->size)
+    {
+        larger.size = this->size ? 2 * this->size : MEMOSTART;
+        larger.count = this->count;
+        TRY( (larger.entries = calloc(larger.size, sizeof *larger.entries)) );
+        for (i = 0; i < this->size; i++)
+        {
+            if (!this->entries[i].paths.limbs) continue;
+            for (j = this->entries[i].key[0] & (larger.size - 1); larger.entries[j].paths.limbs;
+                j = (j + 1) & (larger.size - 1));
+            larger.entries[j] = this->entries[i];
+        }
+        free(this->entries);
+        *this = larger;
+        larger.entries = NULL;
+    }
+    for (i = key[0] & (this->size - 1); this->entries[i].paths.limbs; i = (i + 1) & (this->size - 1));
+    TRY(setBignum(&this->entries[i].paths, 0));
+    TRY(addBignum(&this->entries[i].paths, paths));
+    this->entries[i].key[0] = key[0];
+    this->entries[i].key[1] = key[1];
+    this->count++;
+    added = true;
+
+FINALLY:
+    free(larger.entries);
+    return added;
+}
+
+void freeMemo(struct memo *this)
+{
+    int i;
+
+    for (i = 0; i < this->size; i++) free(this->entries[i].paths.limbs);
+    free(this->entries);
+    this->entries = NULL;
+    this->size = this->count = 0;
+}
+
+bool setBignum(struct bignum *this, uint32_t value)
+{
+    this->nlimbs = 1;
+    this->size = 4;
+    if ( (this->limbs = malloc(sizeof *this->limbs * this->size)) ) this->limbs[0] = value;
+    return this->limbs != NULL;
+}
+
+bool growBignum(struct bignum *this, int size)
+{
+    uint32_t *limbs;
+
+    if (size <= this->size) return true;
+    if (size < this->size * 2) size = this->size * 2;
+    if ( (limbs = realloc(this->limbs, sizeof *limbs * size)) )
+    {
+        this->limbs = limbs;
+        this->size = size;
+    }
+    return limbs != NULL;
+}
+
+bool addBignum(struct bignum *this, struct bignum *other)
+{
+    bool added;
+    int i, nlimbs;
+    uint64_t sum;
+
+    added = false;
+    nlimbs = (this->nlimbs > other->nlimbs ? this->nlimbs : other->nlimbs) + 1;
+    TRY(growBignum(this, nlimbs));
+    for (i = this->nlimbs; i < nlimbs; i++) this->limbs[i] = 0;
+    for (i = 0, sum = 0; i < nlimbs; i++)
+    {
+        sum = (uint64_t)this->limbs[i] + (i < other->nlimbs ? other->limbs[i] : 0) + (sum >> 32);
+        this->limbs[i] = (uint32_t)sum;
+    }
+    this->nlimbs = nlimbs;
+    while (this->nlimbs > 1 && this->limbs[this->nlimbs - 1] == 0) this->nlimbs--;
+    added = true;
+
+FINALLY:
+    return added;
+}
+
+bool multiplyBignum(struct bignum *this, struct bignum *other)
+{
+    bool multiplied;
+    int i, j, nlimbs;
+    uint32_t *limbs;
+    uint64_t product;
+
+    multiplied = false;
+    nlimbs = this->nlimbs + other->nlimbs;
+    TRY( (limbs = calloc(nlimbs + 1, sizeof *limbs)) );
+    for (i = 0; i < this->nlimbs; i++)
+    {
+        for (j = 0, product = 0; j < other->nlimbs; j++)
+        {
+            product = (uint64_t)this->limbs[i] * other->limbs[j] + limbs[i + j] + (product >> 32);
+            limbs[i + j] = (uint32_t)product;
+        }
+        limbs[i + j] = (uint32_t)(product >> 32);
+    }
+    free(this->limbs);
+    this->limbs = limbs;
+    this->nlimbs = nlimbs;
+    this->size = nlimbs + 1;
+    while (this->nlimbs > 1 && this->limbs[this->nlimbs - 1] == 0) this->nlimbs--;
+    multiplied = true;
+
+FINALLY:
+    return multiplied;
+}
+
+/**
+ * Formats a bignum in decimal by dividing it by 10^9 until nothing is left,
+ * and printing the remainders from the last one found.
+ */
+char *formatBignum(struct bignum *this)
+{
+    int i, nlimbs, nchunks;
+    uint32_t *limbs, *chunks;
+    uint64_t remainder;
+    char *decimal, *next;
+
+    decimal = NULL;
+    limbs = chunks = NULL;
+    nlimbs = this->nlimbs;
+    TRY( (limbs = malloc(sizeof *limbs * nlimbs)) );
+    TRY( (chunks = malloc(sizeof *chunks * (nlimbs * 2 + 1))) );
+    memcpy(limbs, this->limbs, sizeof *limbs * nlimbs);
+    nchunks = 0;
+    do
+    {
+        for (i = nlimbs - 1, remainder = 0; i >= 0; i--)
+        {
+            remainder = (remainder << 32) | limbs[i];
+            limbs[i] = (uint32_t)(remainder / 1000000000u);
+            remainder %= 1000000000u;
+        }
+        chunks[nchunks++] = (uint32_t)remainder;
+        while (nlimbs > 0 && limbs[nlimbs - 1] == 0) nlimbs--;
+    } while (nlimbs > 0);
+
+    TRY( (decimal = malloc(9 * nchunks + 2)) );
+    next = decimal + sprintf(decimal, "%lu", (unsigned long)chunks[nchunks - 1]);
+    for (i = nchunks - 2; i >= 0; i--, next += 9)
+        sprintf(next, "%09lu", (unsigned long)chunks[i]);
+
+FINALLY:
+    free(limbs);
+    free(chunks);
+    return decimal;
+}
+
+#undef NORTH
+#undef EAST
+#undef SOUTH
+#undef WEST
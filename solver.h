@@ -0,0 +1,293 @@
+/**
+ * \file solver.h
+ *
+ * Solvers that work on a whole maze at once and print nothing, for use on mazes
+ * too large to be solved by hand one step at a time.
+ */
+
+#ifndef SOLVER_HEADER
+#define SOLVER_HEADER
+
+#include "bool.h"
+#include "maze.h"
+#include "graph.h"
+
+/**
+ * The searches Solver_findPath can find the shortest solution with.
+ */
+#define Solver_bfs 0
+#define Solver_astar 1
+#define Solver_bibfs 2
+
+/**
+ * Marks every room of a maze that cannot lie on any path from its start room to
+ * its finish room as a dead end, in time linear in the number of rooms. A room
+ * lies on such a path exactly when it belongs to one of the blocks that every
+ * path crosses, the parts of the maze that cannot be cut in two by taking away a
+ * single room, so the blocks are found with one depth-first search and the rooms
+ * of every other block are marked. In a maze without loops this leaves only the
+ * solution itself. If the finish cannot be reached, every room but the start is
+ * marked. The searches of Solver_findPath never enter a room marked as a dead
+ * end, so pruning a maze first spares them every dead end in it.
+ *
+ * \param maze The maze to prune.
+ *
+ * \return The number of rooms marked, or -1 if there was not enough memory.
+ */
+int Solver_prune(Maze maze);
+
+/**
+ * Finds the shortest solution to a maze with a breadth-first search. The rooms
+ * on the shortest path are marked as visited once the search is over. If the
+ * length returned is negative, it can be assumed that there was no solution to
+ * the maze found.
+ *
+ * \param maze The maze to solve.
+ * \param room The room to start from.
+ * \param visited If not NULL, set to the number of rooms the search visited.
+ *
+ * \return The length of the shortest path, or -1 if there is none.
+ */
+int Solver_shortestPath(Maze maze, Room room, int *visited);
+
+/**
+ * Finds the shortest solution to a maze with an A* search, always expanding
+ * next the room whose distance from the start plus its Manhattan distance to
+ * the finish is least. The Manhattan distance never overestimates, so the path
+ * found is as short as any. The rooms on the path are marked as visited.
+ *
+ * \param maze The maze to solve.
+ * \param room The room to start from.
+ * \param expanded If not NULL, set to the number of rooms expanded.
+ *
+ * \return The length of the shortest path, or -1 if there is none.
+ */
+int Solver_aStar(Maze maze, Room room, int *expanded);
+
+/**
+ * Finds the shortest solution to a maze with two breadth-first searches, one
+ * from the start room and one from the finish room, taking a whole level of
+ * whichever has the smaller frontier in turn until they meet. The rooms on the
+ * path are marked as visited.
+ *
+ * \param maze The maze to solve.
+ * \param room The room to start from.
+ * \param expanded If not NULL, set to the number of rooms expanded by both
+ *     searches together.
+ *
+ * \return The length of the shortest path, or -1 if there is none.
+ */
+int Solver_bidirectional(Maze maze, Room room, int *expanded);
+
+/**
+ * Finds the shortest solution to a maze from its start room with the search
+ * given, as Solver_shortestPath, Solver_aStar or Solver_bidirectional would.
+ *
+ * \param maze The maze to solve.
+ * \param algorithm One of Solver_bfs, Solver_astar or Solver_bibfs.
+ * \param expanded If not NULL, set to the number of rooms expanded.
+ *
+ * \return The length of the shortest path, or -1 if there is none.
+ */
+int Solver_findPath(Maze maze, int algorithm, int *expanded);
+
+/**
+ * The state of a search for the shortest path between two rooms, kept apart
+ * from the maze so that several threads, each with a search of its own, can
+ * search one maze at once. Starting a new search only takes a new generation
+ * number rather than clearing anything, so a search can be reused cheaply for
+ * query after query.
+ */
+typedef struct search *Search;
+
+/**
+ * Creates a search over a view of a maze. The view is only read, and must
+ * outlive the search.
+ *
+ * \param graph The view of the maze to search.
+ *
+ * \return A new search, or NULL if there was not enough memory.
+ */
+Search Search_new(Graph graph);
+
+/**
+ * Finds the shortest path between two rooms, as Solver_findPath does, but
+ * without marking anything in the maze; the path can be had afterwards from
+ * Search_getPath.
+ *
+ * \param this The search to run.
+ * \param algorithm One of Solver_bfs, Solver_astar or Solver_bibfs.
+ * \param from The offset of the room to start from.
+ * \param to The offset of the room to finish at.
+ * \param expanded If not NULL, set to the number of rooms expanded.
+ *
+ * \return The length of the shortest path, or -1 if there is none or there was
+ *     not enough memory.
+ */
+int Search_findPath(Search this, int algorithm, int from, int to, int *expanded);
+
+/**
+ * Gets the path found by the last call to Search_findPath.
+ *
+ * \param this The search.
+ * \param path The array to fill with the offsets of the rooms of the path, in
+ *     order from the start room to the finish room, both included. It must
+ *     have room for the length of the path plus one.
+ *
+ * \return The number of rooms put in path, or 0 if no path was found.
+ */
+int Search_getPath(Search this, int *path);
+
+/**
+ * Frees a search and sets it to NULL.
+ *
+ * \param this The search to free.
+ */
+void Search_free(Search *this);
+
+/**
+ * An index of a maze without loops, in which there is exactly one path between
+ * any two rooms, that finds the path between two rooms without searching. The
+ * maze is hung as a tree from one room, and each room keeps its parent, its
+ * depth, and one jump pointer to a room further up, placed so that any room a
+ * given number of levels up, and so the lowest room above both of two rooms,
+ * can be reached in a number of steps logarithmic in the number of rooms. The
+ * index is only read once built, so any number of threads can use it at once.
+ */
+typedef struct treeindex *TreeIndex;
+
+/**
+ * Builds the index of a maze without loops, in time and memory linear in the
+ * number of rooms.
+ *
+ * \param graph The view of the maze to index.
+ *
+ * \return A new index, or NULL if the maze has loops, has rooms that cannot be
+ *     reached from every other room, or there was not enough memory.
+ */
+TreeIndex TreeIndex_new(Graph graph);
+
+/**
+ * Gets the length of the path between two rooms.
+ *
+ * \param this The index to use.
+ * \param from The offset of one room.
+ * \param to The offset of the other room.
+ *
+ * \return The length of the path.
+ */
+int TreeIndex_getDistance(TreeIndex this, int from, int to);
+
+/**
+ * Gets the path between two rooms.
+ *
+ * \param this The index to use.
+ * \param from The offset of the room to start from.
+ * \param to The offset of the room to finish at.
+ * \param path The array to fill with the offsets of the rooms of the path, in
+ *     order from the start room to the finish room, both included. It must
+ *     have room for the length of the path plus one.
+ *
+ * \return The number of rooms put in path.
+ */
+int TreeIndex_getPath(TreeIndex this, int from, int to, int *path);
+
+/**
+ * Frees an index and sets it to NULL.
+ *
+ * \param this The index to free.
+ */
+void TreeIndex_free(TreeIndex *this);
+
+/**
+ * The distance of every room of a maze from its finish room, kept up to date as
+ * walls are broken and built one at a time, so that the shortest path from any
+ * room can be had again after each change without searching the whole maze.
+ * Breaking a wall only lowers the distances of the rooms that now reach the
+ * finish sooner through it. Building one finds just the rooms whose every
+ * shortest path crossed it, and works their distances out again from the rooms
+ * around them. Either way, the work done is in proportion to the number of rooms
+ * whose distance changes. A wall standing on one side alone is followed the
+ * way the searches follow it, only blocking the way out of the room it stands
+ * in, and markers are ignored.
+ */
+typedef struct distancefield *DistanceField;
+
+/**
+ * Finds the distance of every room of a maze from its finish room, with one
+ * breadth-first search. The maze must outlive the field, and its finish room
+ * must not change.
+ *
+ * \param maze The maze to find the distances in.
+ *
+ * \return A new distance field, or NULL if there was not enough memory.
+ */
+DistanceField DistanceField_new(Maze maze);
+
+/**
+ * Brings the distances up to date once the wall between two adjacent rooms has
+ * been broken or built. Each change must be passed on before the next is made.
+ *
+ * \param this The field to update.
+ * \param from The offset of one room.
+ * \param to The offset of the other room.
+ *
+ * \return The number of rooms whose distance changed, or -1 if there was not
+ *     enough memory, in which case the field can no longer be used.
+ */
+int DistanceField_update(DistanceField this, int from, int to);
+
+/**
+ * Gets the length of the shortest path from a room to the finish room.
+ *
+ * \param this The field to use.
+ * \param room The offset of the room.
+ *
+ * \return The length of the path, or -1 if there is none.
+ */
+int DistanceField_getDistance(DistanceField this, int room);
+
+/**
+ * Gets a shortest path from a room to the finish room, in time proportional to
+ * its length.
+ *
+ * \param this The field to use.
+ * \param room The offset of the room to start from.
+ * \param path The array to fill with the offsets of the rooms of the path, in
+ *     order from the start room to the finish room, both included. It must
+ *     have room for the length of the path plus one.
+ *
+ * \return The number of rooms put in path, or 0 if there is no path.
+ */
+int DistanceField_getPath(DistanceField this, int room, int *path);
+
+/**
+ * Frees a distance field and sets it to NULL.
+ *
+ * \param this The field to free.
+ */
+void DistanceField_free(DistanceField *this);
+
+/**
+ * Counts the simple paths from the start room of a maze to its finish room,
+ * that is, the paths that never enter the same room twice. The maze is first
+ * split into its blocks, the parts of it that cannot be cut in two by taking
+ * away a single room; every path from start to finish passes through the same
+ * blocks in the same order, entering and leaving each of them by the same
+ * rooms, so the count is the product of the number of paths across each block.
+ * The rooms in dead ends and in loops off to the side of the way from start to
+ * finish are never searched. The paths across each block are then counted by a
+ * depth-first search, split between threads at the first rooms where the paths
+ * branch. The markers of the maze are not changed.
+ *
+ * \param maze The maze to count the solutions of.
+ * \param threads The number of threads to search each block with.
+ * \param progress Whether to show the progress of long searches on the
+ *     standard error stream.
+ *
+ * \return A newly allocated string holding the number of paths in decimal, to
+ *     be freed by the caller, or NULL if there was not enough memory.
+ */
+char *Solver_countPaths(Maze maze, int threads, bool progress);
+
+#endif /* SOLVER_HEADER */